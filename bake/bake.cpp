@@ -0,0 +1,67 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include "fontatlas.h"
+
+// Rasterizes a TrueType font at one size into a font atlas file, so that the demos can
+// upload it as is instead of running SDL_ttf at every launch. The characters default to
+// printable ASCII; pass them as a UTF-8 string to bake a smaller or a larger set. The
+// demos look for <font name>-<size>.fontatlas next to the font, or in the asset archive.
+// With --sdf, the atlas holds a distance field with the given spread in pixels instead,
+// which the demos look for as <font name>-sdf.fontatlas.
+//
+//   bake [--sdf <spread>] <font.ttf> <size> <output.fontatlas> [characters]
+//
+// for instance, from the solution directory
+//
+//   bake fps/arial.ttf 20 fps/arial-20.fontatlas
+//   bake --sdf 4 fps/arial.ttf 32 fps/arial-sdf.fontatlas
+//   bake ttf/arial.ttf 512 ttf/arial-512.fontatlas "Hello SDL!"
+
+int main(int argc, char** argv)
+{
+	int spread = 0;
+	if (argc > 2 && std::string(argv[1]) == "--sdf") {
+		spread = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc < 4) {
+		std::cout << "usage: bake [--sdf <spread>] <font.ttf> <size> <output.fontatlas> [characters]" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	std::vector<Uint32> charset;
+	if (argc > 4) {
+		const std::string characters = argv[4];
+		for (size_t i=0; i < characters.size(); ) {
+			Uint32 c = DecodeUTF8(characters, i);
+			if (std::find(charset.begin(), charset.end(), c) == charset.end()) {
+				charset.push_back(c);
+			}
+		}
+	} else {
+		charset = AsciiCharset();
+	}
+
+	TTF_Init();
+	TTF_Font* font = TTF_OpenFont(argv[1], atoi(argv[2]));
+	if (font == NULL) {
+		std::cout << "Cannot open " << argv[1] << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	FontAtlas atlas = RasterizeFontAtlas(font, atoi(argv[2]), charset, spread);
+	TTF_CloseFont(font);
+	TTF_Quit();
+
+	SDL_RWops* rw = SDL_RWFromFile(argv[3], "wb");
+	if (rw == NULL || !SaveFontAtlas(atlas, rw)) {
+		std::cout << "Cannot write " << argv[3] << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	std::cout << argv[3] << ": " << charset.size() << " glyphs, " << atlas.kerning.size() << " kerning pairs, "
+		<< atlas.width << "x" << atlas.height << " atlas" << std::endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,247 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include "fontatlas.h"
+#include "matrix.h"
+#include "pixels.h"
+
+// Runs every GL demo scene headless through its --bench mode and prints their JSON
+// summaries as one array on stdout, for tracking performance on CI machines without
+// a GPU. Must be started from the solution directory, since each demo loads its assets
+// relative to its own project directory. With --micro, runs the CPU microbenchmarks
+// of the shared code instead.
+//
+//   bench <absolute path to the directory holding the demo executables> [frames]
+//   bench --micro
+
+// Runs f repeatedly and returns how many megapixels of the surface it got through per second.
+template <class F>
+double MegapixelsPerSecond(SDL_Surface* s, F f) {
+	const int iterations = 100;
+	f(); // warm up the caches
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i=0; i < iterations; i++) {
+		f();
+	}
+	double seconds = (SDL_GetPerformanceCounter() - start) / (double) SDL_GetPerformanceFrequency();
+	return (double) s->w * s->h * iterations / seconds / 1e6;
+}
+
+// The per-pixel loop the demos used before SurfaceToRGBA, as the baseline.
+void LegacyPaletteToRGBA(SDL_Surface* s, Uint8* data) {
+	SDL_Palette* palette = s->format->palette;
+	Uint8* p = (Uint8*) s->pixels;
+	Uint8* t = data;
+	for (int i=s->h-1; i >= 0; i--) {
+		for (int j=0; j < s->w; j++) {
+			SDL_Color color = palette->colors[p[i*s->pitch+j]];
+			*t++ = color.r;
+			*t++ = color.g;
+			*t++ = color.b;
+			*t++ = 255;
+		}
+	}
+}
+
+void PixelMicrobenchmark(const char* name, SDL_Surface* s, bool legacy) {
+	std::vector<Uint8> data(s->w * s->h * 4);
+	std::cout << "  {\"microbenchmark\": \"" << name << "\", \"width\": " << s->w << ", \"height\": " << s->h;
+	if (legacy) {
+		std::cout << ", \"legacy_mpix_s\": " << MegapixelsPerSecond(s, [&]() { LegacyPaletteToRGBA(s, &data[0]); });
+	}
+	std::cout << ", \"scalar_mpix_s\": " << MegapixelsPerSecond(s, [&]() { SurfaceToRGBA(s, &data[0], s->w * 4, PIXEL_KERNEL_SCALAR); });
+	if (SDL_HasSSE2()) {
+		std::cout << ", \"sse2_mpix_s\": " << MegapixelsPerSecond(s, [&]() { SurfaceToRGBA(s, &data[0], s->w * 4, PIXEL_KERNEL_SSE2); });
+	}
+	if (SDL_HasAVX2()) {
+		std::cout << ", \"avx2_mpix_s\": " << MegapixelsPerSecond(s, [&]() { SurfaceToRGBA(s, &data[0], s->w * 4, PIXEL_KERNEL_AVX2); });
+	}
+	std::cout << "}";
+}
+
+// Mip level reduction, in megapixels of the larger level. The surface is read as RGBA rows.
+void HalveMicrobenchmark(SDL_Surface* s) {
+	std::vector<Uint8> data(HalvedSize(s->w) * HalvedSize(s->h) * 4);
+	const Uint8* src = (const Uint8*) s->pixels;
+	std::cout << "  {\"microbenchmark\": \"halve_rgba\", \"width\": " << s->w << ", \"height\": " << s->h;
+	std::cout << ", \"scalar_mpix_s\": " << MegapixelsPerSecond(s, [&]() { HalveRGBA(src, s->w, s->h, &data[0], PIXEL_KERNEL_SCALAR); });
+	if (SDL_HasSSE2()) {
+		std::cout << ", \"sse2_mpix_s\": " << MegapixelsPerSecond(s, [&]() { HalveRGBA(src, s->w, s->h, &data[0], PIXEL_KERNEL_SSE2); });
+	}
+	std::cout << "}";
+}
+
+// Runs f, which handles count items, repeatedly and returns how many millions of items it got through per second.
+template <class F>
+double MillionsPerSecond(long count, F f) {
+	const int iterations = 100;
+	f();
+	Uint64 start = SDL_GetPerformanceCounter();
+	for (int i=0; i < iterations; i++) {
+		f();
+	}
+	double seconds = (SDL_GetPerformanceCounter() - start) / (double) SDL_GetPerformanceFrequency();
+	return (double) count * iterations / seconds / 1e6;
+}
+
+// Chains of matrix products, and the transform of a batch of interleaved position and
+// texture coordinate vertices as sprite and text batches lay them out.
+void MatrixMicrobenchmarks() {
+	const int products = 100000;
+	std::vector<Matrix44<float>> matrices(64);
+	for (size_t i=0; i < matrices.size(); i++) {
+		matrices[i] = Translate(i * 0.01f, 1.0f, 0.0f);
+	}
+	Matrix44<float> product = Identity<float>();
+	std::cout << "  {\"microbenchmark\": \"matrix_multiply\", \"count\": " << products;
+	std::cout << ", \"scalar_mops_s\": " << MillionsPerSecond(products, [&]() {
+		for (int i=0; i < products; i++) {
+			product = Multiply(product, matrices[i & 63]);
+		}
+	});
+	std::cout << ", \"simd_mops_s\": " << MillionsPerSecond(products, [&]() {
+		for (int i=0; i < products; i++) {
+			product = product * matrices[i & 63];
+		}
+	});
+	std::cout << ", \"checksum\": " << product.m[0] << "}," << std::endl; // keeps the loops from being optimized away
+
+	const int vertices = 100000;
+	const int stride = 5;
+	std::vector<float> batch(vertices * stride, 1.0f);
+	const Matrix44<float> mat = Ortho(1024.0f, 0.0f, 768.0f, 0.0f, 1.0f, -1.0f) * Translate(10.0f, 20.0f, 0.0f);
+	std::cout << "  {\"microbenchmark\": \"transform_points\", \"count\": " << vertices;
+	std::cout << ", \"scalar_mverts_s\": " << MillionsPerSecond(vertices, [&]() { TransformPointsScalar(mat, &batch[0], vertices, stride); });
+	std::cout << ", \"simd_mverts_s\": " << MillionsPerSecond(vertices, [&]() { TransformPoints(mat, &batch[0], vertices, stride); });
+	std::cout << "}";
+}
+
+// The size and the build time of the per size bitmap atlases the demos used, against the
+// single distance field atlas that serves every size.
+void FontAtlasMicrobenchmarks() {
+	TTF_Init();
+	struct Case {
+		int size;
+		int spread;
+	} cases[] = { { 20, 0 }, { 128, 0 }, { 512, 0 }, { 32, 4 } };
+	const int caseCount = sizeof(cases) / sizeof(cases[0]);
+	for (int i=0; i < caseCount; i++) {
+		TTF_Font* font = TTF_OpenFont("fps/arial.ttf", cases[i].size);
+		if (font == NULL) {
+			break;
+		}
+		Uint64 start = SDL_GetPerformanceCounter();
+		FontAtlas atlas = RasterizeFontAtlas(font, cases[i].size, AsciiCharset(), cases[i].spread);
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		TTF_CloseFont(font);
+		std::cout << "," << std::endl << "  {\"microbenchmark\": \"font_atlas\", \"kind\": \""
+			<< (atlas.DistanceField() ? "distance_field" : "bitmap") << "\", \"size\": " << cases[i].size
+			<< ", \"width\": " << atlas.width << ", \"height\": " << atlas.height
+			<< ", \"bytes\": " << atlas.pixels.size() << ", \"ms\": " << ms << "}";
+	}
+	TTF_Quit();
+}
+
+int RunMicrobenchmarks() {
+	const int size = 512;
+	SDL_Surface* palettized = SDL_CreateRGBSurface(0, size, size, 8, 0, 0, 0, 0);
+	for (int i=0; i < palettized->format->palette->ncolors; i++) {
+		SDL_Color c = { (Uint8) i, (Uint8) (255 - i), (Uint8) (i * 7), 255 };
+		palettized->format->palette->colors[i] = c;
+	}
+	SDL_Surface* blended = SDL_CreateRGBSurface(0, size, size, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+	srand(1);
+	for (int i=0; i < size; i++) {
+		Uint8* row8 = (Uint8*) palettized->pixels + i * palettized->pitch;
+		Uint32* row32 = (Uint32*) ((Uint8*) blended->pixels + i * blended->pitch);
+		for (int j=0; j < size; j++) {
+			row8[j] = rand() % 256;
+			row32[j] = (Uint32) rand() << 16 ^ (Uint32) rand(); // RAND_MAX may be as small as 32767
+		}
+	}
+
+	std::cout << "[" << std::endl;
+	PixelMicrobenchmark("palette_to_rgba", palettized, true);
+	std::cout << "," << std::endl;
+	PixelMicrobenchmark("argb_to_rgba", blended, false);
+	std::cout << "," << std::endl;
+	HalveMicrobenchmark(blended);
+	std::cout << "," << std::endl;
+	MatrixMicrobenchmarks();
+	FontAtlasMicrobenchmarks();
+	std::cout << std::endl << "]" << std::endl;
+
+	SDL_FreeSurface(palettized);
+	SDL_FreeSurface(blended);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && std::string(argv[1]) == "--micro") {
+		return RunMicrobenchmarks();
+	}
+	if (argc < 2) {
+		std::cout << "usage: bench <executable directory> [frames]" << std::endl;
+		std::cout << "       bench --micro" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	const std::string binDir = argv[1];
+	const int frames = argc > 2 ? atoi(argv[2]) : 500;
+	// scenes are named after their demo unless the demo runs them from a flag
+	const struct {
+		const char* name;
+		const char* demo;
+		const char* args;
+	} scenes[] = {
+		{ "glew", "glew", "" },
+		{ "fps", "fps", "" },
+		{ "sprites", "fps", "--sprites 100000" },
+		{ "mix", "mix", "" },
+		{ "fullscr", "fullscr", "" },
+		{ "dblctx", "dblctx", "" },
+		{ "image", "image", "" }
+	};
+	const int sceneCount = sizeof(scenes) / sizeof(scenes[0]);
+
+	int failures = 0;
+	std::cout << "[" << std::endl;
+	for (int i=0; i < sceneCount; i++) {
+		const std::string scene = scenes[i].name;
+		const std::string demo = scenes[i].demo;
+		const std::string output = "bench_" + scene + ".json";
+		std::stringstream command;
+		command << "cd " << demo << " && \"" << binDir << "/" << demo << "\" " << scenes[i].args << " --bench " << frames << " > \"../" << output << "\"";
+		int status = system(command.str().c_str());
+		std::ifstream f(output);
+		std::stringstream result;
+		result << f.rdbuf();
+		f.close();
+		remove(output.c_str());
+		std::string json = result.str();
+		json = json.substr(0, json.find_last_not_of("\r\n") + 1);
+		if (status != 0 || json.empty()) {
+			// a demo that gave up printed why on its last line
+			std::string reason = json.substr(json.find_last_of("\r\n") + 1);
+			std::string error = "exit status " + std::to_string(status) + (reason.empty() ? "" : ": ");
+			for (char c : reason) {
+				if (c == '"' || c == '\\') {
+					error += '\\';
+				}
+				error += c;
+			}
+			failures++;
+			json = "{\"scene\": \"" + scene + "\", \"error\": \"" + error + "\"}";
+		}
+		std::cout << "  " << json << (i < sceneCount - 1 ? "," : "") << std::endl;
+	}
+	std::cout << "]" << std::endl;
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
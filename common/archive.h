@@ -0,0 +1,183 @@
+#pragma once
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string.h>
+#include <SDL.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Layout of the packed asset files written by the pack tool: a header, an index of
+// fixed size entries, then the blobs, each starting on an ARCHIVE_ALIGNMENT boundary.
+// All fields are little endian.
+const char ARCHIVE_MAGIC[8] = { 'S', 'D', 'L', 'P', 'A', 'K', '1', 0 };
+const int ARCHIVE_ALIGNMENT = 16;
+const int ARCHIVE_NAME_LENGTH = 48;
+
+struct ArchiveHeader {
+	char magic[8];
+	Uint32 count;
+	Uint32 reserved;
+};
+
+struct ArchiveEntry {
+	Uint64 offset; // from the start of the file
+	Uint64 size;
+	char name[ARCHIVE_NAME_LENGTH]; // nul terminated
+};
+
+// A view of a blob inside the mapped archive, valid as long as the archive is open.
+struct ArchiveSpan {
+	const Uint8* data;
+	size_t size;
+};
+
+// A packed asset file mapped in memory. Assets are looked up by file name and handed out
+// without copies, as spans or as read-only SDL_RWops, so loading them costs page faults
+// instead of an open and a read each. When no archive could be opened, Open and ReadText
+// fall back to the loose file of the same name, so the demos still run from an unpacked
+// checkout.
+struct Archive {
+	Archive() : base(NULL), size(0) {
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#endif
+	}
+	// Maps filename, returning false when it is missing or not an archive.
+	bool Map(const std::string& filename) {
+#ifdef _WIN32
+		file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(file, &fileSize);
+		size = (size_t) fileSize.QuadPart;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL) {
+			base = (const Uint8*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+#else
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		fstat(fd, &st);
+		size = st.st_size;
+		void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd); // the mapping keeps the file alive
+		base = p == MAP_FAILED ? NULL : (const Uint8*) p;
+#endif
+		if (base == NULL || size < sizeof(ArchiveHeader) || memcmp(Header().magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0
+				|| Header().count > (size - sizeof(ArchiveHeader)) / sizeof(ArchiveEntry) || !EntriesValid()) {
+			std::cout << "Not an asset archive: " << filename << std::endl;
+			Unmap();
+			return false;
+		}
+		return true;
+	}
+	bool Mapped() const {
+		return base != NULL;
+	}
+	// Returns a span with NULL data when name is not in the archive.
+	ArchiveSpan Find(const std::string& name) const {
+		ArchiveSpan span = { NULL, 0 };
+		if (!Mapped()) {
+			return span;
+		}
+		const ArchiveEntry* entries = (const ArchiveEntry*) (base + sizeof(ArchiveHeader));
+		for (Uint32 i=0; i < Header().count; i++) {
+			if (strncmp(entries[i].name, name.c_str(), ARCHIVE_NAME_LENGTH) == 0) {
+				span.data = base + entries[i].offset;
+				span.size = (size_t) entries[i].size;
+				break;
+			}
+		}
+		return span;
+	}
+	// The caller owns the returned stream, which reads the mapped blob in place.
+	SDL_RWops* Open(const std::string& name) const {
+		SDL_RWops* rw = TryOpen(name);
+		if (rw == NULL) {
+			std::cout << "Asset not found: " << name << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		return rw;
+	}
+	// Like Open, but returns NULL for optional assets that are missing.
+	SDL_RWops* TryOpen(const std::string& name) const {
+		ArchiveSpan span = Find(name);
+		if (span.data != NULL) {
+			return SDL_RWFromConstMem(span.data, (int) span.size);
+		}
+		return SDL_RWFromFile(name.c_str(), "rb");
+	}
+	std::string ReadText(const std::string& name) const {
+		ArchiveSpan span = Find(name);
+		if (span.data != NULL) {
+			return std::string((const char*) span.data, span.size);
+		}
+		std::ifstream f(name);
+		std::stringstream buffer;
+		buffer << f.rdbuf();
+		return buffer.str();
+	}
+	~Archive() {
+		Unmap();
+	}
+private:
+	const ArchiveHeader& Header() const {
+		return *(const ArchiveHeader*) base;
+	}
+	// Every blob lies inside the file and every name is terminated, so that a truncated or
+	// corrupt archive is rejected rather than read past its end.
+	bool EntriesValid() const {
+		const ArchiveEntry* entries = (const ArchiveEntry*) (base + sizeof(ArchiveHeader));
+		for (Uint32 i=0; i < Header().count; i++) {
+			if (entries[i].offset > size || entries[i].size > size - entries[i].offset
+					|| memchr(entries[i].name, 0, ARCHIVE_NAME_LENGTH) == NULL) {
+				return false;
+			}
+		}
+		return true;
+	}
+	void Unmap() {
+#ifdef _WIN32
+		if (base != NULL) {
+			UnmapViewOfFile(base);
+		}
+		if (mapping != NULL) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#else
+		if (base != NULL) {
+			munmap((void*) base, size);
+		}
+#endif
+		base = NULL;
+		size = 0;
+	}
+	const Uint8* base;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+	Archive(const Archive&);
+};
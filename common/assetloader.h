@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <SDL.h>
+
+// Prepares assets - file reads, image decoding, glyph rasterization - on a pool of worker
+// threads, so that the work overlaps with window and GL context creation. Jobs must not
+// touch GL: the GL thread waits for their result through the returned future and does the
+// upload itself. A loader without workers runs every job inline in Load, which is the
+// serial startup it replaces.
+struct AssetLoader {
+	AssetLoader(int workers = DefaultWorkers()) {
+		stopping = false;
+		for (int i=0; i < workers; i++) {
+			threads.push_back(std::thread(&AssetLoader::Work, this));
+		}
+	}
+	~AssetLoader() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i=0; i < threads.size(); i++) {
+			threads[i].join();
+		}
+	}
+	template <class F>
+	std::shared_future<typename std::result_of<F()>::type> Load(F job) {
+		typedef typename std::result_of<F()>::type T;
+		std::shared_ptr<std::packaged_task<T()>> task(new std::packaged_task<T()>(job));
+		std::shared_future<T> result = task->get_future().share();
+		if (threads.empty()) {
+			(*task)();
+			return result;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back([task]() { (*task)(); });
+		}
+		wake.notify_one();
+		return result;
+	}
+	// leaves a core to the GL thread
+	static int DefaultWorkers() {
+		return std::max(1, SDL_GetCPUCount() - 1);
+	}
+private:
+	void Work() {
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (!stopping && queue.empty()) {
+					wake.wait(lock);
+				}
+				if (queue.empty()) {
+					return;
+				}
+				job = queue.front();
+				queue.pop_front();
+			}
+			job();
+		}
+	}
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+	AssetLoader(const AssetLoader&);
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <SDL.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Turns a demo into a benchmark when it is started with "--bench <frames>". The demo
+// then renders through SDL's offscreen video driver, which creates its GL context with
+// EGL and so runs on Mesa's llvmpipe without a display or a GPU; setting SDL_VIDEODRIVER
+// overrides the choice. SDL builds without that driver (the Windows ones) keep the
+// default driver, and the demo renders to hidden windows instead. After one warm-up
+// frame, <frames> frames are timed without vsync and a JSON summary is printed on
+// stdout. Must be constructed before SDL_Init, first thing in main, since it also
+// measures the time to the first presented frame.
+struct Bench {
+	std::string scene;
+	int frames; // 0 when not benchmarking
+	int frame;
+	long drawCalls; // the demo adds every draw call it issues
+	Uint64 launch;
+	Uint64 start;
+	double cpuStart;
+	double firstFrameMs;
+	Bench(const std::string& scene_, int argc, char** argv) {
+		launch = SDL_GetPerformanceCounter();
+		firstFrameMs = -1.0;
+		scene = scene_;
+		frames = 0;
+		frame = 0;
+		drawCalls = 0;
+		for (int i=1; i < argc - 1; i++) {
+			if (std::string(argv[i]) == "--bench") {
+				frames = atoi(argv[i+1]);
+			}
+		}
+		if (Enabled() && SDL_getenv("SDL_VIDEODRIVER") == NULL) {
+			// SDL 2.0.14 reads the driver from the environment only, and fails SDL_Init when
+			// the one asked for was not compiled in
+			for (int i=0; i < SDL_GetNumVideoDrivers(); i++) {
+				if (std::string(SDL_GetVideoDriver(i)) == "offscreen") {
+					SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+				}
+			}
+		}
+	}
+	bool Enabled() const {
+		return frames > 0;
+	}
+	// The flags to create the demo's windows with: benchmarks never show theirs.
+	Uint32 WindowFlags(Uint32 flags) const {
+		return Enabled() ? (flags & ~SDL_WINDOW_SHOWN) | SDL_WINDOW_HIDDEN : flags;
+	}
+	// Call after every presented frame. Returns false once the benchmark is over.
+	bool Frame() {
+		if (firstFrameMs < 0.0) {
+			firstFrameMs = (SDL_GetPerformanceCounter() - launch) * 1000.0 / SDL_GetPerformanceFrequency();
+			if (!Enabled()) {
+				std::cout << "Time to first frame: " << firstFrameMs << " ms" << std::endl;
+			}
+		}
+		if (!Enabled()) {
+			return true;
+		}
+		if (frame == 0) {
+			SDL_GL_SetSwapInterval(0);
+			start = SDL_GetPerformanceCounter();
+			cpuStart = CpuSeconds();
+			drawCalls = 0;
+		}
+		if (frame++ < frames) {
+			return true;
+		}
+		double seconds = (SDL_GetPerformanceCounter() - start) / (double) SDL_GetPerformanceFrequency();
+		double cpuSeconds = CpuSeconds() - cpuStart;
+		std::cout << "{\"scene\": \"" << scene << "\""
+			<< ", \"video_driver\": \"" << SDL_GetCurrentVideoDriver() << "\""
+			<< ", \"time_to_first_frame_ms\": " << firstFrameMs
+			<< ", \"frames\": " << frames
+			<< ", \"seconds\": " << seconds
+			<< ", \"fps\": " << frames / seconds
+			<< ", \"cpu_ms_per_frame\": " << cpuSeconds * 1000.0 / frames
+			<< ", \"draw_calls_per_frame\": " << (double) drawCalls / frames
+			<< "}" << std::endl;
+		return false;
+	}
+	// CPU time used by the whole process, driver threads included
+	static double CpuSeconds() {
+#ifdef _WIN32
+		FILETIME creation, exit, kernel, user;
+		GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+		ULARGE_INTEGER k, u;
+		k.LowPart = kernel.dwLowDateTime;
+		k.HighPart = kernel.dwHighDateTime;
+		u.LowPart = user.dwLowDateTime;
+		u.HighPart = user.dwHighDateTime;
+		return (k.QuadPart + u.QuadPart) / 1e7;
+#else
+		timespec ts;
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+		return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+	}
+};
+
+// Exits with SDL's error when a call the demo cannot go on without has failed. The
+// message goes to stdout, where the bench runner picks it up.
+inline void RequireSDL(bool ok, const char* call) {
+	if (!ok) {
+		std::cout << call << " failed: " << SDL_GetError() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+}
@@ -0,0 +1,351 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include "pixels.h"
+
+// Location of a glyph inside the font atlas, in pixels, and where to draw it relative to
+// the pen, which sits at the bottom of the line box. Glyphs are tight boxes placed after
+// their metrics, see RenderGlyph; blank ones such as the space are zero sized.
+struct Glyph {
+	int x, y; // bottom left corner in the atlas, whose rows are stored bottom row first
+	int width;
+	int height;
+	int offsetX, offsetY;
+	int advance;
+};
+
+// The rasterized glyphs of a font at one size, as one byte per atlas pixel, ready to be
+// uploaded as a GL_R8 texture. Built without touching GL, either by rasterizing a
+// TrueType font or by loading an atlas baked offline by the bake tool, so that it can be
+// prepared by the asset loader.
+// The bytes are coverage, unless spread is set: they then hold the signed distance to the
+// nearest glyph edge, 0.5 on the edge itself and 0 or 1 spread pixels away from it, out-
+// or inside. A distance field atlas rasterized at a modest size is sharp at any scale
+// once the shader thresholds it, which is what size is for.
+struct FontAtlas {
+	static const int PADDING = 1; // keeps linear filtering from bleeding neighbours in
+	int width;
+	int height;
+	int size; // in points
+	int spread; // in atlas pixels, 0 for a coverage atlas
+	std::vector<Uint8> pixels;
+	std::vector<Glyph> glyphs; // indexed by code point, zero sized for missing ones
+	std::map<Uint32, int> kerning; // (first << 16 | second) code points to the pixels to add between them
+
+	FontAtlas() : width(0), height(0), size(0), spread(0) {}
+	bool DistanceField() const {
+		return spread > 0;
+	}
+	bool Contains(Uint32 c) const {
+		return c < glyphs.size() && (glyphs[c].advance > 0 || glyphs[c].width > 0);
+	}
+	int Kerning(Uint32 first, Uint32 second) const {
+		auto it = kerning.find(first << 16 | second);
+		return it == kerning.end() ? 0 : it->second;
+	}
+};
+
+// The printable ASCII characters, which is what the demos write.
+inline std::vector<Uint32> AsciiCharset() {
+	std::vector<Uint32> charset;
+	for (Uint32 c=32; c <= 126; c++) {
+		charset.push_back(c);
+	}
+	return charset;
+}
+
+inline std::string EncodeUTF8(Uint32 c) {
+	std::string s;
+	if (c < 0x80) {
+		s += (char) c;
+	} else if (c < 0x800) {
+		s += (char) (0xc0 | c >> 6);
+		s += (char) (0x80 | (c & 0x3f));
+	} else {
+		s += (char) (0xe0 | c >> 12);
+		s += (char) (0x80 | (c >> 6 & 0x3f));
+		s += (char) (0x80 | (c & 0x3f));
+	}
+	return s;
+}
+
+// Reads the code point starting at s[i] and moves i past it. Malformed sequences and code
+// points beyond the basic multilingual plane come out as U+FFFD.
+inline Uint32 DecodeUTF8(const std::string& s, size_t& i) {
+	Uint8 lead = (Uint8) s[i++];
+	int continuation = lead < 0x80 ? 0 : lead >= 0xf0 ? 3 : lead >= 0xe0 ? 2 : lead >= 0xc0 ? 1 : -1;
+	if (continuation < 0) {
+		return 0xfffd;
+	}
+	Uint32 c = continuation == 0 ? lead : lead & (0x3f >> continuation);
+	for (int k=0; k < continuation; k++) {
+		if (i >= s.size() || ((Uint8) s[i] & 0xc0) != 0x80) {
+			return 0xfffd;
+		}
+		c = c << 6 | ((Uint8) s[i++] & 0x3f);
+	}
+	return c > 0xffff ? 0xfffd : c;
+}
+
+// Turns the coverage in data into a distance field, see FontAtlas. The antialiased coverage
+// places the edge inside the pixels it crosses: a pixel with coverage a is taken to be cut
+// by a straight edge, a - 0.5 pixels from its center, rather than being wholly in or out,
+// which would snap the outline to the pixel grid and show its staircase when magnified.
+// Pixels wholly in or out walk the offsets within spread in order of distance, looking
+// for the nearest edge among the pixels that are not, so the cost is bounded by the
+// spread, and lower for the many pixels close to an edge.
+inline void CoverageToDistanceField(std::vector<Uint8>& data, int width, int height, int spread) {
+	struct Offset {
+		int dx, dy;
+		float distance;
+		bool operator<(const Offset& that) const {
+			return distance < that.distance;
+		}
+	};
+	std::vector<Offset> offsets;
+	for (int dy=-spread; dy <= spread; dy++) {
+		for (int dx=-spread; dx <= spread; dx++) {
+			Offset o = { dx, dy, std::sqrt((float) (dx * dx + dy * dy)) };
+			if (o.distance > 0.0f && o.distance <= spread) {
+				offsets.push_back(o);
+			}
+		}
+	}
+	std::sort(offsets.begin(), offsets.end());
+	std::vector<Uint8> field(data.size());
+	for (int y=0; y < height; y++) {
+		for (int x=0; x < width; x++) {
+			const Uint8 coverage = data[y * width + x];
+			float signedDistance; // positive inside
+			if (coverage != 0 && coverage != 255) {
+				signedDistance = coverage / 255.0f - 0.5f;
+			} else {
+				const bool inside = coverage == 255;
+				float distance = (float) spread;
+				for (size_t i=0; i < offsets.size() && offsets[i].distance - 0.5f < distance; i++) {
+					int ox = x + offsets[i].dx, oy = y + offsets[i].dy;
+					if (ox < 0 || ox >= width || oy < 0 || oy >= height || data[oy * width + ox] == coverage) {
+						continue;
+					}
+					// the part of that pixel on the other side of the edge is its far side, as seen from here
+					const float other = (inside ? 255 - data[oy * width + ox] : data[oy * width + ox]) / 255.0f;
+					distance = std::min(distance, offsets[i].distance + 0.5f - other);
+				}
+				signedDistance = inside ? distance : -distance;
+			}
+			float value = 0.5f + signedDistance / (2 * spread);
+			field[y * width + x] = (Uint8) (std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+		}
+	}
+	data.swap(field);
+}
+
+// Renders glyph c in its line box, which gives the same placement on every version of
+// SDL_ttf, and crops the box to the glyph metrics. The coverage of the cropped box is
+// written to coverage, bottom row first, and its size and metrics to g, whose position
+// is left to the caller.
+inline void RenderGlyph(TTF_Font* font, Uint32 c, Glyph& g, std::vector<Uint8>& coverage) {
+	int minx, maxx, miny, maxy, advance;
+	TTF_GlyphMetrics(font, (Uint16) c, &minx, &maxx, &miny, &maxy, &advance);
+	SDL_Color white = { 255, 255, 255, 255 };
+	SDL_Color black = { 0, 0, 0, 255 };
+	SDL_Surface* s = TTF_RenderUTF8_Shaded(font, EncodeUTF8(c).c_str(), white, black);
+	if (s == NULL) {
+		std::cout << "Failed to render glyph " << c << ": " << TTF_GetError() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	std::vector<Uint8> box(s->w * s->h);
+	SurfaceToCoverage(s, &box[0], s->w);
+	const int ascent = TTF_FontAscent(font);
+	const int left = std::max(0, minx), right = std::min(s->w, std::max(left, maxx));
+	const int bottom = std::max(0, s->h - std::max(0, ascent - miny)); // in rows from the bottom of the box
+	const int top = std::max(bottom, s->h - std::max(0, ascent - maxy));
+	g.x = 0;
+	g.y = 0;
+	g.width = right - left;
+	g.height = top - bottom;
+	g.offsetX = left;
+	g.offsetY = bottom;
+	g.advance = advance;
+	coverage.resize(g.width * g.height);
+	for (int row=0; row < g.height && g.width > 0; row++) {
+		memcpy(&coverage[row * g.width], &box[(bottom + row) * s->w + left], g.width);
+	}
+	SDL_FreeSurface(s);
+}
+
+// Renders every glyph of charset, which SDL_ttf limits to the basic multilingual plane,
+// and shelf packs them into an atlas with power of two sides. With a spread, every glyph
+// gets that many pixels of room on each side and the atlas is turned into a distance field.
+inline FontAtlas RasterizeFontAtlas(TTF_Font* font, int size, const std::vector<Uint32>& charset, int spread = 0) {
+	const int margin = FontAtlas::PADDING + spread;
+	FontAtlas atlas;
+	Uint32 maxChar = charset.empty() ? 0 : *std::max_element(charset.begin(), charset.end());
+	atlas.glyphs.resize(maxChar + 1);
+	std::vector<std::vector<Uint8>> coverages(charset.size());
+	int maxWidth = 0, area = 0;
+	for (size_t i=0; i < charset.size(); i++) {
+		Glyph& g = atlas.glyphs[charset[i]];
+		RenderGlyph(font, charset[i], g, coverages[i]);
+		maxWidth = std::max(maxWidth, g.width);
+		area += (g.width + margin + spread) * (g.height + margin + spread);
+	}
+
+	// wide enough for every glyph, and for the atlas to come out roughly square
+	atlas.size = size;
+	atlas.spread = spread;
+	atlas.width = 256;
+	while (atlas.width < maxWidth + 2 * margin || atlas.width * atlas.width < area) {
+		atlas.width *= 2;
+	}
+
+	// pack every glyph on a shelf, moving to a new shelf when the row is full
+	int x = margin, y = margin, shelfHeight = 0;
+	for (size_t i=0; i < charset.size(); i++) {
+		Glyph& g = atlas.glyphs[charset[i]];
+		if (x + g.width + margin > atlas.width) {
+			x = margin;
+			y += shelfHeight + margin + spread;
+			shelfHeight = 0;
+		}
+		g.x = x;
+		g.y = y;
+		x += g.width + margin + spread;
+		shelfHeight = std::max(shelfHeight, g.height);
+	}
+	atlas.height = 1;
+	while (atlas.height < y + shelfHeight + margin) {
+		atlas.height *= 2;
+	}
+
+	// copy the glyph coverage into a single channel image
+	atlas.pixels.resize(atlas.width * atlas.height, 0);
+	for (size_t i=0; i < charset.size(); i++) {
+		const Glyph& g = atlas.glyphs[charset[i]];
+		for (int row=0; row < g.height; row++) {
+			memcpy(&atlas.pixels[(g.y + row) * atlas.width + g.x], &coverages[i][row * g.width], g.width);
+		}
+	}
+	for (size_t i=0; i < charset.size(); i++) {
+		for (size_t j=0; j < charset.size(); j++) {
+			int k = TTF_GetFontKerningSizeGlyphs(font, (Uint16) charset[i], (Uint16) charset[j]);
+			if (k != 0) {
+				atlas.kerning[charset[i] << 16 | charset[j]] = k;
+			}
+		}
+	}
+	if (spread > 0) {
+		CoverageToDistanceField(atlas.pixels, atlas.width, atlas.height, spread);
+	}
+	return atlas;
+}
+
+// Baked atlas files, all fields little endian: the magic, then width, height, size, spread,
+// glyph count and kerning pair count, then per glyph its code point, x, y, width, height,
+// x and y offsets and advance, per kerning pair its first and second code points and
+// amount, and finally the coverage, bottom row first.
+const char FONT_ATLAS_MAGIC[8] = { 'S', 'D', 'L', 'F', 'N', 'T', '3', 0 };
+const int FONT_ATLAS_GLYPH_BYTES = 8 * 4;
+
+inline bool SaveFontAtlas(const FontAtlas& atlas, SDL_RWops* rw) {
+	bool ok = SDL_RWwrite(rw, FONT_ATLAS_MAGIC, sizeof(FONT_ATLAS_MAGIC), 1) == 1;
+	Uint32 glyphCount = 0;
+	for (size_t c=0; c < atlas.glyphs.size(); c++) {
+		glyphCount += atlas.Contains(c) ? 1 : 0;
+	}
+	SDL_WriteLE32(rw, atlas.width);
+	SDL_WriteLE32(rw, atlas.height);
+	SDL_WriteLE32(rw, atlas.size);
+	SDL_WriteLE32(rw, atlas.spread);
+	SDL_WriteLE32(rw, glyphCount);
+	SDL_WriteLE32(rw, atlas.kerning.size());
+	for (size_t c=0; c < atlas.glyphs.size(); c++) {
+		const Glyph& g = atlas.glyphs[c];
+		if (atlas.Contains(c)) {
+			SDL_WriteLE32(rw, c);
+			SDL_WriteLE32(rw, g.x);
+			SDL_WriteLE32(rw, g.y);
+			SDL_WriteLE32(rw, g.width);
+			SDL_WriteLE32(rw, g.height);
+			SDL_WriteLE32(rw, g.offsetX);
+			SDL_WriteLE32(rw, g.offsetY);
+			SDL_WriteLE32(rw, g.advance);
+		}
+	}
+	for (auto it = atlas.kerning.begin(); it != atlas.kerning.end(); it++) {
+		SDL_WriteLE16(rw, it->first >> 16);
+		SDL_WriteLE16(rw, it->first & 0xffff);
+		SDL_WriteLE32(rw, it->second);
+	}
+	ok = ok && SDL_RWwrite(rw, &atlas.pixels[0], atlas.pixels.size(), 1) == 1;
+	SDL_RWclose(rw);
+	return ok;
+}
+
+// Returns false, with atlas left empty, when rw does not hold a baked atlas, or holds one
+// whose counts and sizes disagree with the length of the stream.
+inline bool LoadFontAtlas(FontAtlas& atlas, SDL_RWops* rw) {
+	char magic[sizeof(FONT_ATLAS_MAGIC)];
+	if (SDL_RWread(rw, magic, sizeof(magic), 1) != 1 || memcmp(magic, FONT_ATLAS_MAGIC, sizeof(magic)) != 0) {
+		SDL_RWclose(rw);
+		return false;
+	}
+	Uint32 width = SDL_ReadLE32(rw);
+	Uint32 height = SDL_ReadLE32(rw);
+	atlas.size = SDL_ReadLE32(rw);
+	atlas.spread = SDL_ReadLE32(rw);
+	Uint32 glyphCount = SDL_ReadLE32(rw);
+	Uint32 kerningCount = SDL_ReadLE32(rw);
+	const Sint64 remaining = SDL_RWsize(rw) - SDL_RWtell(rw);
+	if (width == 0 || height == 0 || width > 16384 || height > 16384 || glyphCount > 0x10000
+			|| remaining != (Sint64) glyphCount * FONT_ATLAS_GLYPH_BYTES + (Sint64) kerningCount * 8 + (Sint64) width * height) {
+		SDL_RWclose(rw);
+		atlas = FontAtlas();
+		return false;
+	}
+	atlas.width = width;
+	atlas.height = height;
+	bool ok = true;
+	for (Uint32 i=0; i < glyphCount; i++) {
+		Uint32 c = SDL_ReadLE32(rw);
+		if (c > 0xffff) {
+			ok = false; // atlases only hold the basic multilingual plane
+			break;
+		}
+		if (c >= atlas.glyphs.size()) {
+			atlas.glyphs.resize(c + 1);
+		}
+		Glyph& g = atlas.glyphs[c];
+		g.x = SDL_ReadLE32(rw);
+		g.y = SDL_ReadLE32(rw);
+		g.width = SDL_ReadLE32(rw);
+		g.height = SDL_ReadLE32(rw);
+		g.offsetX = (Sint32) SDL_ReadLE32(rw);
+		g.offsetY = (Sint32) SDL_ReadLE32(rw);
+		g.advance = (Sint32) SDL_ReadLE32(rw);
+	}
+	for (Uint32 i=0; ok && i < kerningCount; i++) {
+		Uint32 first = SDL_ReadLE16(rw);
+		Uint32 second = SDL_ReadLE16(rw);
+		atlas.kerning[first << 16 | second] = (Sint32) SDL_ReadLE32(rw);
+	}
+	if (ok) {
+		atlas.pixels.resize(atlas.width * atlas.height);
+		ok = SDL_RWread(rw, &atlas.pixels[0], atlas.pixels.size(), 1) == 1;
+	}
+	SDL_RWclose(rw);
+	if (!ok) {
+		atlas = FontAtlas();
+		return false;
+	}
+	return true;
+}
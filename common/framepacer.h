@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <SDL.h>
+#include "bench.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002 // Windows 10 1803, missing from older SDKs
+#endif
+#else
+#include <time.h>
+#endif
+
+enum PacingMode {
+	PACING_VSYNC,
+	PACING_ADAPTIVE, // vsync, but late frames are presented right away instead of waiting another refresh
+	PACING_UNCAPPED,
+	PACING_FIXED
+};
+
+// Decides when the frames of a demo are presented, with "--pacing vsync" (the default),
+// "--pacing adaptive", "--pacing uncapped" or a fixed rate in Hz such as "--pacing 30".
+// Fixed rates run without vsync: the pacer sleeps until shortly before each deadline and
+// spins the rest of the way. The spin tail follows the worst recent oversleep, so the
+// thread sleeps as much as the timer allows without missing deadlines. Benchmarks always
+// run uncapped.
+// Once a second the pacer sums up the frame rate, how far the frame intervals strayed
+// from the target interval, and the CPU time the whole process used per second, which is
+// what vsync and lower rates save.
+struct FramePacer {
+	PacingMode mode;
+	double targetHz; // the fixed rate, or the refresh rate of the display with vsync once known
+	bool adaptiveUnsupported;
+	FramePacer(int argc, char** argv) {
+		mode = PACING_VSYNC;
+		targetHz = 0.0;
+		for (int i=1; i < argc - 1; i++) {
+			std::string arg = argv[i], value = argv[i+1];
+			if (arg == "--pacing") {
+				if (value == "adaptive") {
+					mode = PACING_ADAPTIVE;
+				} else if (value == "uncapped") {
+					mode = PACING_UNCAPPED;
+				} else if (atof(value.c_str()) > 0.0) {
+					mode = PACING_FIXED;
+					targetHz = atof(value.c_str());
+				}
+			}
+			if (arg == "--bench") {
+				mode = PACING_UNCAPPED;
+				break;
+			}
+		}
+		Init();
+	}
+	// For pacing another thread with the settings of an existing pacer, which cannot be
+	// copied since each one owns its timer.
+	FramePacer(PacingMode mode_, double targetHz_) {
+		mode = mode_;
+		targetHz = targetHz_;
+		Init();
+	}
+	~FramePacer() {
+#ifdef _WIN32
+		if (timer != NULL) {
+			CloseHandle(timer);
+		}
+#endif
+	}
+	// Sets the swap interval of the GL context current in the calling thread.
+	void Apply() {
+		if (mode == PACING_ADAPTIVE && SDL_GL_SetSwapInterval(-1) != 0) {
+			adaptiveUnsupported = true; // needs EXT_swap_control_tear
+		}
+		if (mode == PACING_VSYNC || adaptiveUnsupported) {
+			SDL_GL_SetSwapInterval(1);
+		} else if (mode != PACING_ADAPTIVE) {
+			SDL_GL_SetSwapInterval(0);
+		}
+	}
+	// The flags to create an SDL_Renderer with, instead of Apply. Renderers only know
+	// plain vsync.
+	Uint32 RendererFlags() const {
+		return mode == PACING_VSYNC || mode == PACING_ADAPTIVE ? SDL_RENDERER_PRESENTVSYNC : 0;
+	}
+	// Call right after every present. Returns true when the summary has been updated.
+	bool Frame() {
+		if (mode != PACING_FIXED && !refreshQueried) {
+			// the pacer is made before SDL_Init, when the display cannot be asked yet
+			SDL_DisplayMode display;
+			targetHz = SDL_GetCurrentDisplayMode(0, &display) == 0 ? display.refresh_rate : 0.0;
+			refreshQueried = true;
+		}
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (mode == PACING_FIXED) {
+			const Uint64 period = (Uint64) (frequency / targetHz);
+			deadline = deadline == 0 ? now + period : deadline + period;
+			if (deadline <= now) {
+				deadline = now; // late, start over from here rather than rushing frames to catch up
+			} else {
+				SleepUntil(deadline);
+				now = SDL_GetPerformanceCounter();
+			}
+		}
+		if (lastFrame != 0) {
+			const double intervalMs = (now - lastFrame) * 1000.0 / frequency;
+			const double hz = TargetHz();
+			if (hz > 0.0) {
+				double errorMs = std::fabs(intervalMs - 1000.0 / hz);
+				errorSumMs += errorMs;
+				errorMaxMs = std::max(errorMaxMs, errorMs);
+			}
+			frames++;
+		}
+		lastFrame = now;
+		if (reportStart == 0) {
+			reportStart = now;
+			reportCpuStart = Bench::CpuSeconds();
+			return false;
+		}
+		const double seconds = (now - reportStart) / (double) frequency;
+		if (seconds < 1.0) {
+			return false;
+		}
+		const double cpuSeconds = Bench::CpuSeconds() - reportCpuStart;
+		std::stringstream s;
+		s.precision(2);
+		s << std::fixed << ModeName() << ": " << frames / seconds << " fps";
+		if (TargetHz() > 0.0 && frames > 0) {
+			s << ", pacing error avg " << errorSumMs / frames << " max " << errorMaxMs << " ms";
+		}
+		s.precision(0);
+		s << ", cpu " << cpuSeconds * 100.0 / seconds << "%";
+		summary = s.str();
+		reportStart = now;
+		reportCpuStart += cpuSeconds;
+		frames = 0;
+		errorSumMs = 0.0;
+		errorMaxMs = 0.0;
+		return true;
+	}
+	// Empty until the first second has gone by.
+	const std::string& Summary() const {
+		return summary;
+	}
+private:
+	void Init() {
+		adaptiveUnsupported = false;
+		frequency = SDL_GetPerformanceFrequency();
+		deadline = 0;
+		lastFrame = 0;
+		spinTicks = frequency / 1000;
+		reportStart = 0;
+		reportCpuStart = 0.0;
+		frames = 0;
+		errorSumMs = 0.0;
+		errorMaxMs = 0.0;
+		refreshQueried = false;
+#ifdef _WIN32
+		// Sleep is only as fine as the system timer, 15.6 ms unless someone raised it
+		timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (timer == NULL) {
+			timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+		}
+#endif
+	}
+	// The interval errors are measured against, none when uncapped.
+	double TargetHz() const {
+		return mode == PACING_UNCAPPED ? 0.0 : targetHz;
+	}
+	std::string ModeName() const {
+		std::stringstream s;
+		switch (mode) {
+		case PACING_VSYNC: s << "vsync"; break;
+		case PACING_ADAPTIVE: s << (adaptiveUnsupported ? "vsync (no adaptive)" : "adaptive vsync"); break;
+		case PACING_UNCAPPED: s << "uncapped"; break;
+		case PACING_FIXED: s << "fixed " << targetHz << " Hz"; break;
+		}
+		return s.str();
+	}
+	void SleepUntil(Uint64 until) {
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (until > now + spinTicks) {
+			const Uint64 sleepTicks = until - spinTicks - now;
+			Sleep(sleepTicks);
+			const Uint64 woke = SDL_GetPerformanceCounter();
+			const Uint64 oversleep = woke > now + sleepTicks ? woke - now - sleepTicks : 0;
+			// grows right away, shrinks slowly so that a single good wake up does not cause a miss
+			spinTicks = std::max(oversleep, spinTicks - spinTicks / 16);
+		}
+		while (SDL_GetPerformanceCounter() < until) {
+		}
+	}
+	void Sleep(Uint64 ticks) {
+#ifdef _WIN32
+		LARGE_INTEGER due;
+		due.QuadPart = -(LONGLONG) (ticks * 10000000 / frequency); // relative, in 100 ns units
+		if (timer != NULL && SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+			WaitForSingleObject(timer, INFINITE);
+		} else {
+			::Sleep((DWORD) (ticks * 1000 / frequency));
+		}
+#else
+		timespec ts;
+		ts.tv_sec = ticks / frequency;
+		ts.tv_nsec = (long) ((ticks % frequency) * 1000000000 / frequency);
+		nanosleep(&ts, NULL);
+#endif
+	}
+	Uint64 frequency;
+	Uint64 deadline;
+	Uint64 lastFrame;
+	Uint64 spinTicks;
+	Uint64 reportStart;
+	double reportCpuStart;
+	int frames;
+	double errorSumMs;
+	double errorMaxMs;
+	bool refreshQueried;
+	std::string summary;
+#ifdef _WIN32
+	HANDLE timer;
+#endif
+	FramePacer(const FramePacer&);
+	FramePacer& operator=(const FramePacer&);
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <SDL.h>
+
+// Frame time statistics over the last WINDOW frames, measured with the high resolution
+// performance counter. Percentiles come from a histogram of BUCKET_US wide buckets kept
+// in step with the window, so they are exact to that resolution; frames longer than
+// the histogram range all land in its last bucket. A frame longer than the budget
+// counts as a hitch.
+struct FrameStats {
+	static const int WINDOW = 300;
+	static const int BUCKET_US = 10;
+	static const int BUCKETS = 10000; // 100ms
+	double budgetMs;
+	std::vector<double> samples; // ring of the last WINDOW frame times, in ms
+	std::vector<int> histogram;
+	int count;
+	int hitches;
+	double sumMs;
+	Uint64 last;
+	Uint64 frequency;
+	long frame;
+	std::ofstream csv;
+	FrameStats(double budgetMs_ = 1000.0 / 60) {
+		budgetMs = budgetMs_;
+		samples.resize(WINDOW);
+		histogram.resize(BUCKETS);
+		count = 0;
+		hitches = 0;
+		sumMs = 0;
+		last = 0;
+		frequency = SDL_GetPerformanceFrequency();
+		frame = 0;
+	}
+	// Also writes every frame time to a CSV file, for offline analysis.
+	void StartCsv(const std::string& filename) {
+		csv.open(filename);
+		csv << "frame,ms" << std::endl;
+	}
+	// Call once per frame; the first call only starts the clock.
+	void Frame() {
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (last != 0) {
+			Add((now - last) * 1000.0 / frequency);
+		}
+		last = now;
+	}
+	void Add(double ms) {
+		int slot = frame % WINDOW;
+		if (count == WINDOW) {
+			Remove(samples[slot]);
+		} else {
+			count++;
+		}
+		samples[slot] = ms;
+		histogram[Bucket(ms)]++;
+		sumMs += ms;
+		hitches += ms > budgetMs;
+		if (csv.is_open()) {
+			csv << frame << "," << ms << "\n";
+		}
+		frame++;
+	}
+	int Count() const {
+		return count;
+	}
+	int Hitches() const {
+		return hitches;
+	}
+	double AvgMs() const {
+		return count > 0 ? sumMs / count : 0.0;
+	}
+	double MinMs() const {
+		double min = count > 0 ? samples[0] : 0.0;
+		for (int i=1; i < count; i++) {
+			min = std::min(min, samples[i]);
+		}
+		return min;
+	}
+	double MaxMs() const {
+		double max = count > 0 ? samples[0] : 0.0;
+		for (int i=1; i < count; i++) {
+			max = std::max(max, samples[i]);
+		}
+		return max;
+	}
+	// p between 0 and 100, returns the middle of the bucket holding that percentile
+	double PercentileMs(double p) const {
+		int rank = (int) (p / 100.0 * count + 0.5);
+		int seen = 0;
+		for (int i=0; i < BUCKETS; i++) {
+			seen += histogram[i];
+			if (seen >= rank && seen > 0) {
+				return (i + 0.5) * BUCKET_US / 1000.0;
+			}
+		}
+		return 0.0;
+	}
+private:
+	void Remove(double ms) {
+		histogram[Bucket(ms)]--;
+		sumMs -= ms;
+		hitches -= ms > budgetMs;
+	}
+	static int Bucket(double ms) {
+		int bucket = (int) (ms * 1000.0 / BUCKET_US);
+		return bucket < BUCKETS ? bucket : BUCKETS - 1;
+	}
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <SDL.h>
+#include <GL/glew.h>
+
+// Measures named render passes on both sides: the CPU time spent submitting them and,
+// through GL_TIME_ELAPSED queries, the time the GPU spent executing them. Every pass
+// owns a ring of LATENCY queries and results are collected LATENCY-1 frames after
+// they were issued, when the GPU is normally done with them, so reading them never
+// waits. A pass whose query is still in flight when its slot comes round again is
+// simply not measured that frame. Time elapsed queries cannot nest, so neither can passes.
+struct GpuTimer {
+	static const int LATENCY = 4;
+	struct Pass {
+		std::string name;
+		GLuint queries[LATENCY];
+		bool pending[LATENCY];
+		double cpuMs;
+		double gpuMs;
+	};
+	std::vector<Pass> passes;
+	bool supported;
+	int frame;
+	int active; // pass being measured, or -1
+	Uint64 cpuStart;
+	GpuTimer() {
+		supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+		frame = 0;
+		active = -1;
+	}
+	int AddPass(const std::string& name) {
+		Pass pass;
+		pass.name = name;
+		pass.cpuMs = 0;
+		pass.gpuMs = 0;
+		for (int i=0; i < LATENCY; i++) {
+			pass.pending[i] = false;
+		}
+		if (supported) {
+			glGenQueries(LATENCY, pass.queries);
+		}
+		passes.push_back(pass);
+		return passes.size() - 1;
+	}
+	void Begin(int pass) {
+		cpuStart = SDL_GetPerformanceCounter();
+		int slot = frame % LATENCY;
+		Pass& p = passes[pass];
+		if (!supported || (p.pending[slot] && !Collect(p, slot))) {
+			return;
+		}
+		glBeginQuery(GL_TIME_ELAPSED, p.queries[slot]);
+		p.pending[slot] = true;
+		active = pass;
+	}
+	void End(int pass) {
+		passes[pass].cpuMs = (SDL_GetPerformanceCounter() - cpuStart) * 1000.0 / SDL_GetPerformanceFrequency();
+		if (active == pass) {
+			glEndQuery(GL_TIME_ELAPSED);
+			active = -1;
+		}
+	}
+	// Collects the results that have come back. Call once per frame, after the last pass.
+	void EndFrame() {
+		frame++;
+		int slot = frame % LATENCY; // the oldest queries, issued LATENCY-1 frames ago
+		for (size_t i=0; i < passes.size(); i++) {
+			if (passes[i].pending[slot]) {
+				Collect(passes[i], slot);
+			}
+		}
+	}
+	~GpuTimer() {
+		if (supported) {
+			for (size_t i=0; i < passes.size(); i++) {
+				glDeleteQueries(LATENCY, passes[i].queries);
+			}
+		}
+	}
+private:
+	bool Collect(Pass& p, int slot) {
+		GLint available;
+		glGetQueryObjectiv(p.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			return false;
+		}
+		GLuint64 ns;
+		glGetQueryObjectui64v(p.queries[slot], GL_QUERY_RESULT, &ns);
+		p.gpuMs = ns / 1000000.0;
+		p.pending[slot] = false;
+		return true;
+	}
+	GpuTimer(const GpuTimer&);
+};
+
+// Measures a pass for the lifetime of the scope.
+struct GpuTimerScope {
+	GpuTimer& timer;
+	int pass;
+	GpuTimerScope(GpuTimer& timer_, int pass_) : timer(timer_), pass(pass_) {
+		timer.Begin(pass);
+	}
+	~GpuTimerScope() {
+		timer.End(pass);
+	}
+private:
+	GpuTimerScope(const GpuTimerScope&);
+};
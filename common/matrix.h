@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define MATRIX_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MATRIX_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Visual C++ 2013 knows neither constexpr nor alignas.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define MATRIX_CONSTEXPR inline
+#else
+#define MATRIX_CONSTEXPR constexpr
+#endif
+#if defined(_MSC_VER)
+#define MATRIX_ALIGN __declspec(align(16))
+#else
+#define MATRIX_ALIGN __attribute__((aligned(16)))
+#endif
+
+// 4x4 matrices stored column major, the layout glUniformMatrix4fv takes without
+// transposing, so element (row, col) is m[col * 4 + row]. The builders and Multiply
+// are single expressions, so a projection built from constants is computed by the
+// compiler wherever constexpr is supported. operator* and TransformPoints are the
+// runtime paths, with SSE and NEON kernels for float matrices. The SIMD loads do not
+// rely on the 16 byte alignment, since heap blocks are only 8 byte aligned on 32-bit
+// Windows. Matrices are passed by reference: Visual C++ cannot pass aligned types by value.
+template <class T>
+struct MATRIX_ALIGN Matrix44
+{
+	T m[16];
+};
+
+template <class T>
+MATRIX_CONSTEXPR Matrix44<T> Identity() {
+	return Matrix44<T>{{
+		1, 0, 0, 0,
+		0, 1, 0, 0,
+		0, 0, 1, 0,
+		0, 0, 0, 1
+	}};
+}
+
+template <class T>
+MATRIX_CONSTEXPR Matrix44<T> Translate(T x, T y, T z) {
+	return Matrix44<T>{{
+		1, 0, 0, 0,
+		0, 1, 0, 0,
+		0, 0, 1, 0,
+		x, y, z, 1
+	}};
+}
+
+template <class T>
+MATRIX_CONSTEXPR Matrix44<T> Scale(T x, T y, T z) {
+	return Matrix44<T>{{
+		x, 0, 0, 0,
+		0, y, 0, 0,
+		0, 0, z, 0,
+		0, 0, 0, 1
+	}};
+}
+
+template <class T>
+MATRIX_CONSTEXPR Matrix44<T> Ortho(T right, T left, T top, T bottom, T nearp, T farp) {
+	return Matrix44<T>{{
+		2 / (right - left), 0, 0, 0,
+		0, 2 / (top - bottom), 0, 0,
+		0, 0, 2 / (farp - nearp), 0,
+		-(right + left) / (right - left), -(top + bottom) / (top - bottom), -(farp + nearp) / (farp - nearp), 1
+	}};
+}
+
+// fovy is in radians. Not constexpr, because std::tan is not.
+template <class T>
+Matrix44<T> Perspective(T fovy, T aspect, T nearp, T farp) {
+	T f = 1 / std::tan(fovy / 2);
+	return Matrix44<T>{{
+		f / aspect, 0, 0, 0,
+		0, f, 0, 0,
+		0, 0, (farp + nearp) / (nearp - farp), -1,
+		0, 0, 2 * farp * nearp / (nearp - farp), 0
+	}};
+}
+
+template <class T>
+MATRIX_CONSTEXPR Matrix44<T> Transpose(const Matrix44<T>& a) {
+	return Matrix44<T>{{
+		a.m[0], a.m[4], a.m[8], a.m[12],
+		a.m[1], a.m[5], a.m[9], a.m[13],
+		a.m[2], a.m[6], a.m[10], a.m[14],
+		a.m[3], a.m[7], a.m[11], a.m[15]
+	}};
+}
+
+template <class T>
+MATRIX_CONSTEXPR T MultiplyElement(const Matrix44<T>& a, const Matrix44<T>& b, int row, int col) {
+	return a.m[row] * b.m[col*4] + a.m[4+row] * b.m[col*4+1] + a.m[8+row] * b.m[col*4+2] + a.m[12+row] * b.m[col*4+3];
+}
+
+// a * b, applying b first.
+template <class T>
+MATRIX_CONSTEXPR Matrix44<T> Multiply(const Matrix44<T>& a, const Matrix44<T>& b) {
+	return Matrix44<T>{{
+		MultiplyElement(a, b, 0, 0), MultiplyElement(a, b, 1, 0), MultiplyElement(a, b, 2, 0), MultiplyElement(a, b, 3, 0),
+		MultiplyElement(a, b, 0, 1), MultiplyElement(a, b, 1, 1), MultiplyElement(a, b, 2, 1), MultiplyElement(a, b, 3, 1),
+		MultiplyElement(a, b, 0, 2), MultiplyElement(a, b, 1, 2), MultiplyElement(a, b, 2, 2), MultiplyElement(a, b, 3, 2),
+		MultiplyElement(a, b, 0, 3), MultiplyElement(a, b, 1, 3), MultiplyElement(a, b, 2, 3), MultiplyElement(a, b, 3, 3)
+	}};
+}
+
+template <class T>
+Matrix44<T> operator*(const Matrix44<T>& a, const Matrix44<T>& b) {
+	return Multiply(a, b);
+}
+
+inline Matrix44<float> operator*(const Matrix44<float>& a, const Matrix44<float>& b) {
+	Matrix44<float> r;
+#if defined(MATRIX_SSE)
+	// every column of the result is a combination of the columns of a
+	__m128 a0 = _mm_loadu_ps(a.m);
+	__m128 a1 = _mm_loadu_ps(a.m + 4);
+	__m128 a2 = _mm_loadu_ps(a.m + 8);
+	__m128 a3 = _mm_loadu_ps(a.m + 12);
+	for (int col=0; col < 4; col++) {
+		const float* c = b.m + col * 4;
+		__m128 v = _mm_mul_ps(a0, _mm_set1_ps(c[0]));
+		v = _mm_add_ps(v, _mm_mul_ps(a1, _mm_set1_ps(c[1])));
+		v = _mm_add_ps(v, _mm_mul_ps(a2, _mm_set1_ps(c[2])));
+		v = _mm_add_ps(v, _mm_mul_ps(a3, _mm_set1_ps(c[3])));
+		_mm_storeu_ps(r.m + col * 4, v);
+	}
+#elif defined(MATRIX_NEON)
+	float32x4_t a0 = vld1q_f32(a.m);
+	float32x4_t a1 = vld1q_f32(a.m + 4);
+	float32x4_t a2 = vld1q_f32(a.m + 8);
+	float32x4_t a3 = vld1q_f32(a.m + 12);
+	for (int col=0; col < 4; col++) {
+		const float* c = b.m + col * 4;
+		float32x4_t v = vmulq_n_f32(a0, c[0]);
+		v = vmlaq_n_f32(v, a1, c[1]);
+		v = vmlaq_n_f32(v, a2, c[2]);
+		v = vmlaq_n_f32(v, a3, c[3]);
+		vst1q_f32(r.m + col * 4, v);
+	}
+#else
+	r = Multiply(a, b);
+#endif
+	return r;
+}
+
+// Stores the inverse of a in inverse and returns true, or returns false when a is singular.
+template <class T>
+bool Invert(const Matrix44<T>& a, Matrix44<T>& inverse) {
+	const T* m = a.m;
+	T inv[16];
+	inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+	inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+	inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+	inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+	inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+	inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+	inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+	inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+	inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+	inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+	inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+	inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+	inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+	inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+	inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+	inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+	T det = m[0]*inv[0] + m[1]*inv[4] + m[2]*inv[8] + m[3]*inv[12];
+	if (det == 0) {
+		return false;
+	}
+	for (int i=0; i < 16; i++) {
+		inverse.m[i] = inv[i] / det;
+	}
+	return true;
+}
+
+// Transforms count points in place, the x, y, z of each being followed by stride - 3
+// other floats, such as texture coordinates, that are left alone. Points are taken with
+// w = 1 and there is no perspective divide, which suits the affine and orthographic
+// matrices of sprite and text batches.
+inline void TransformPointsScalar(const Matrix44<float>& mat, float* points, int count, int stride) {
+	const float* m = mat.m;
+	for (int i=0; i < count; i++, points += stride) {
+		float x = points[0], y = points[1], z = points[2];
+		points[0] = m[0] * x + m[4] * y + m[8] * z + m[12];
+		points[1] = m[1] * x + m[5] * y + m[9] * z + m[13];
+		points[2] = m[2] * x + m[6] * y + m[10] * z + m[14];
+	}
+}
+
+inline void TransformPoints(const Matrix44<float>& mat, float* points, int count, int stride) {
+#if defined(MATRIX_SSE)
+	__m128 c0 = _mm_loadu_ps(mat.m);
+	__m128 c1 = _mm_loadu_ps(mat.m + 4);
+	__m128 c2 = _mm_loadu_ps(mat.m + 8);
+	__m128 c3 = _mm_loadu_ps(mat.m + 12);
+	for (int i=0; i < count; i++, points += stride) {
+		__m128 v = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_set1_ps(points[0])));
+		v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(points[1])));
+		v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(points[2])));
+		// only x, y and z are written back, the fourth float belongs to the next attribute
+		_mm_storel_pi((__m64*) points, v);
+		_mm_store_ss(points + 2, _mm_movehl_ps(v, v));
+	}
+#elif defined(MATRIX_NEON)
+	float32x4_t c0 = vld1q_f32(mat.m);
+	float32x4_t c1 = vld1q_f32(mat.m + 4);
+	float32x4_t c2 = vld1q_f32(mat.m + 8);
+	float32x4_t c3 = vld1q_f32(mat.m + 12);
+	for (int i=0; i < count; i++, points += stride) {
+		float32x4_t v = vmlaq_n_f32(c3, c0, points[0]);
+		v = vmlaq_n_f32(v, c1, points[1]);
+		v = vmlaq_n_f32(v, c2, points[2]);
+		vst1_f32(points, vget_low_f32(v));
+		vst1q_lane_f32(points + 2, v, 2);
+	}
+#else
+	TransformPointsScalar(mat, points, count, stride);
+#endif
+}
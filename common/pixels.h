@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <SDL.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PIXELS_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// GCC and Clang only emit AVX2 instructions in functions that ask for them; MSVC always does.
+#if defined(PIXELS_X86) && defined(__GNUC__)
+#define PIXELS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PIXELS_TARGET_AVX2
+#endif
+
+// Conversion of SDL surfaces into the tightly packed RGBA8 data glTexImage2D takes,
+// bottom row first. 8-bit palettized surfaces are expanded through a 256 entry table
+// of 32-bit colors and come out opaque, like the per-pixel loops this replaces.
+// 32-bit surfaces are swizzled according to their channel masks, and anything else
+// is converted to 32 bits by SDL first. The row kernels come in scalar, SSE2 and AVX2
+// flavours, the best one supported by the CPU being picked at runtime.
+
+enum PixelKernel {
+	PIXEL_KERNEL_BEST,
+	PIXEL_KERNEL_SCALAR,
+	PIXEL_KERNEL_SSE2,
+	PIXEL_KERNEL_AVX2
+};
+
+// Where each channel sits in a 32-bit source pixel.
+struct PixelShifts {
+	int r, g, b, a;
+	bool opaque; // no alpha channel in the source
+};
+
+inline Uint32 PackRGBA(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+	// byte order in memory is r, g, b, a
+	return r | (g << 8) | (b << 16) | ((Uint32) a << 24);
+}
+
+inline void PaletteRowScalar(const Uint8* src, Uint32* dst, int width, const Uint32* table) {
+	for (int j=0; j < width; j++) {
+		dst[j] = table[src[j]];
+	}
+}
+
+inline void SwizzleRowScalar(const Uint32* src, Uint32* dst, int width, const PixelShifts& s) {
+	for (int j=0; j < width; j++) {
+		Uint32 p = src[j];
+		dst[j] = PackRGBA((Uint8) (p >> s.r), (Uint8) (p >> s.g), (Uint8) (p >> s.b), s.opaque ? 255 : (Uint8) (p >> s.a));
+	}
+}
+
+#ifdef PIXELS_X86
+
+// SSE2 has no gather, so the lookups stay scalar but the stores go out 16 bytes at a time.
+inline void PaletteRowSSE2(const Uint8* src, Uint32* dst, int width, const Uint32* table) {
+	int j = 0;
+	for (; j + 4 <= width; j += 4) {
+		__m128i v = _mm_set_epi32(table[src[j+3]], table[src[j+2]], table[src[j+1]], table[src[j]]);
+		_mm_storeu_si128((__m128i*) (dst + j), v);
+	}
+	PaletteRowScalar(src + j, dst + j, width - j, table);
+}
+
+inline void SwizzleRowSSE2(const Uint32* src, Uint32* dst, int width, const PixelShifts& s) {
+	const __m128i mask = _mm_set1_epi32(0xff);
+	const __m128i r = _mm_cvtsi32_si128(s.r);
+	const __m128i g = _mm_cvtsi32_si128(s.g);
+	const __m128i b = _mm_cvtsi32_si128(s.b);
+	const __m128i a = _mm_cvtsi32_si128(s.a);
+	const __m128i alpha = _mm_set1_epi32(s.opaque ? 0xff000000 : 0);
+	int j = 0;
+	for (; j + 4 <= width; j += 4) {
+		__m128i p = _mm_loadu_si128((const __m128i*) (src + j));
+		__m128i out = _mm_and_si128(_mm_srl_epi32(p, r), mask);
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_and_si128(_mm_srl_epi32(p, g), mask), 8));
+		out = _mm_or_si128(out, _mm_slli_epi32(_mm_and_si128(_mm_srl_epi32(p, b), mask), 16));
+		if (s.opaque) {
+			out = _mm_or_si128(out, alpha);
+		} else {
+			out = _mm_or_si128(out, _mm_slli_epi32(_mm_srl_epi32(p, a), 24));
+		}
+		_mm_storeu_si128((__m128i*) (dst + j), out);
+	}
+	SwizzleRowScalar(src + j, dst + j, width - j, s);
+}
+
+PIXELS_TARGET_AVX2 inline void PaletteRowAVX2(const Uint8* src, Uint32* dst, int width, const Uint32* table) {
+	int j = 0;
+	for (; j + 8 <= width; j += 8) {
+		__m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (src + j)));
+		__m256i v = _mm256_i32gather_epi32((const int*) table, indices, 4);
+		_mm256_storeu_si256((__m256i*) (dst + j), v);
+	}
+	PaletteRowScalar(src + j, dst + j, width - j, table);
+}
+
+PIXELS_TARGET_AVX2 inline void SwizzleRowAVX2(const Uint32* src, Uint32* dst, int width, const PixelShifts& s) {
+	const __m256i mask = _mm256_set1_epi32(0xff);
+	const __m128i r = _mm_cvtsi32_si128(s.r);
+	const __m128i g = _mm_cvtsi32_si128(s.g);
+	const __m128i b = _mm_cvtsi32_si128(s.b);
+	const __m128i a = _mm_cvtsi32_si128(s.a);
+	const __m256i alpha = _mm256_set1_epi32(s.opaque ? 0xff000000 : 0);
+	int j = 0;
+	for (; j + 8 <= width; j += 8) {
+		__m256i p = _mm256_loadu_si256((const __m256i*) (src + j));
+		__m256i out = _mm256_and_si256(_mm256_srl_epi32(p, r), mask);
+		out = _mm256_or_si256(out, _mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(p, g), mask), 8));
+		out = _mm256_or_si256(out, _mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(p, b), mask), 16));
+		if (s.opaque) {
+			out = _mm256_or_si256(out, alpha);
+		} else {
+			out = _mm256_or_si256(out, _mm256_slli_epi32(_mm256_srl_epi32(p, a), 24));
+		}
+		_mm256_storeu_si256((__m256i*) (dst + j), out);
+	}
+	SwizzleRowScalar(src + j, dst + j, width - j, s);
+}
+
+#endif
+
+inline PixelKernel BestPixelKernel() {
+#ifdef PIXELS_X86
+	static const PixelKernel best = SDL_HasAVX2() ? PIXEL_KERNEL_AVX2 : SDL_HasSSE2() ? PIXEL_KERNEL_SSE2 : PIXEL_KERNEL_SCALAR;
+	return best;
+#else
+	return PIXEL_KERNEL_SCALAR;
+#endif
+}
+
+// 8-bit surfaces with colors to look up; others, such as RGB332, are converted like any
+// format that is not 32-bit.
+inline bool HasPalette(const SDL_Surface* s) {
+	return s->format->BitsPerPixel == 8 && s->format->palette != NULL && s->format->palette->ncolors > 0;
+}
+
+// Writes the surface as RGBA8 into dst: row i of dst, dstPitch bytes after row i-1,
+// receives row h-1-i of the surface.
+inline void SurfaceToRGBA(SDL_Surface* surface, Uint8* dst, int dstPitch, PixelKernel kernel = PIXEL_KERNEL_BEST) {
+	if (kernel == PIXEL_KERNEL_BEST) {
+		kernel = BestPixelKernel();
+	}
+	SDL_Surface* s = surface;
+	if (!HasPalette(s) && s->format->BitsPerPixel != 32) {
+		s = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+	}
+	if (SDL_MUSTLOCK(s)) {
+		SDL_LockSurface(s);
+	}
+	if (HasPalette(s)) {
+		Uint32 table[256];
+		SDL_Palette* palette = s->format->palette;
+		for (int i=0; i < 256; i++) {
+			SDL_Color c = i < palette->ncolors ? palette->colors[i] : palette->colors[0];
+			table[i] = PackRGBA(c.r, c.g, c.b, 255);
+		}
+		for (int i=0; i < s->h; i++) {
+			const Uint8* row = (const Uint8*) s->pixels + (s->h-1-i) * s->pitch;
+			Uint32* out = (Uint32*) (dst + i * dstPitch);
+			switch (kernel) {
+#ifdef PIXELS_X86
+			case PIXEL_KERNEL_AVX2: PaletteRowAVX2(row, out, s->w, table); break;
+			case PIXEL_KERNEL_SSE2: PaletteRowSSE2(row, out, s->w, table); break;
+#endif
+			default: PaletteRowScalar(row, out, s->w, table); break;
+			}
+		}
+	} else {
+		const SDL_PixelFormat* f = s->format;
+		PixelShifts shifts = { f->Rshift, f->Gshift, f->Bshift, f->Ashift, f->Amask == 0 };
+		for (int i=0; i < s->h; i++) {
+			const Uint32* row = (const Uint32*) ((const Uint8*) s->pixels + (s->h-1-i) * s->pitch);
+			Uint32* out = (Uint32*) (dst + i * dstPitch);
+			switch (kernel) {
+#ifdef PIXELS_X86
+			case PIXEL_KERNEL_AVX2: SwizzleRowAVX2(row, out, s->w, shifts); break;
+			case PIXEL_KERNEL_SSE2: SwizzleRowSSE2(row, out, s->w, shifts); break;
+#endif
+			default: SwizzleRowScalar(row, out, s->w, shifts); break;
+			}
+		}
+	}
+	if (SDL_MUSTLOCK(s)) {
+		SDL_UnlockSurface(s);
+	}
+	if (s != surface) {
+		SDL_FreeSurface(s);
+	}
+}
+
+// Writes the coverage of a white-on-black rendered surface as one byte per pixel into
+// dst, flipped the same way as SurfaceToRGBA. Palettized surfaces, such as the ones
+// TTF_RenderText_Solid and TTF_RenderText_Shaded return, take the brightest channel of
+// each palette entry; 32-bit surfaces, such as blended text, take their alpha.
+inline void SurfaceToCoverage(SDL_Surface* surface, Uint8* dst, int dstPitch) {
+	SDL_Surface* s = surface;
+	if (!HasPalette(s) && s->format->BitsPerPixel != 32) {
+		s = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+	}
+	if (SDL_MUSTLOCK(s)) {
+		SDL_LockSurface(s);
+	}
+	if (HasPalette(s)) {
+		Uint8 table[256] = { 0 };
+		SDL_Palette* palette = s->format->palette;
+		for (int i=0; i < palette->ncolors && i < 256; i++) {
+			SDL_Color c = palette->colors[i];
+			table[i] = std::max(c.r, std::max(c.g, c.b));
+		}
+		for (int i=0; i < s->h; i++) {
+			const Uint8* row = (const Uint8*) s->pixels + (s->h-1-i) * s->pitch;
+			Uint8* out = dst + i * dstPitch;
+			for (int j=0; j < s->w; j++) {
+				out[j] = table[row[j]];
+			}
+		}
+	} else {
+		const SDL_PixelFormat* f = s->format;
+		for (int i=0; i < s->h; i++) {
+			const Uint32* row = (const Uint32*) ((const Uint8*) s->pixels + (s->h-1-i) * s->pitch);
+			Uint8* out = dst + i * dstPitch;
+			for (int j=0; j < s->w; j++) {
+				out[j] = f->Amask ? (Uint8) (row[j] >> f->Ashift) : 255;
+			}
+		}
+	}
+	if (SDL_MUSTLOCK(s)) {
+		SDL_UnlockSurface(s);
+	}
+	if (s != surface) {
+		SDL_FreeSurface(s);
+	}
+}
+
+// Halving of tightly packed RGBA8 images, bottom row first, to build mipmap chains on the
+// CPU: every output pixel is the rounded average of a 2x2 box of source pixels. Levels are
+// rounded down in size as GL's are, so odd sizes drop their last column or row, and a side
+// of 1 is averaged with itself. A box filter is what glGenerateMipmap does on most
+// drivers, so both paths give the same pyramid. Scalar and SSE2 row kernels.
+
+inline int HalvedSize(int size) {
+	return std::max(1, size / 2);
+}
+
+inline void HalveRowScalar(const Uint8* row0, const Uint8* row1, Uint8* dst, int srcWidth, int from, int to) {
+	for (int j=from; j < to; j++) {
+		const int x0 = 2 * j * 4, x1 = std::min(2 * j + 1, srcWidth - 1) * 4;
+		for (int c=0; c < 4; c++) {
+			dst[j * 4 + c] = (Uint8) ((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+		}
+	}
+}
+
+#ifdef PIXELS_X86
+
+// four output pixels from eight source pixels of each row
+inline void HalveRowSSE2(const Uint8* row0, const Uint8* row1, Uint8* dst, int srcWidth, int dstWidth) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	int j = 0;
+	for (; j + 4 <= srcWidth / 2; j += 4) {
+		__m128i sums[4];
+		for (int k=0; k < 2; k++) {
+			__m128i a = _mm_loadu_si128((const __m128i*) (row0 + (2 * j + 4 * k) * 4));
+			__m128i b = _mm_loadu_si128((const __m128i*) (row1 + (2 * j + 4 * k) * 4));
+			// vertical sums of pixels 0 and 1, then of pixels 2 and 3, as 16 bit channels
+			__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+			// horizontal sums of the pixel pairs, in the low 64 bits
+			sums[2 * k] = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+			sums[2 * k + 1] = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+		}
+		__m128i p01 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sums[0], sums[1]), two), 2);
+		__m128i p23 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(sums[2], sums[3]), two), 2);
+		_mm_storeu_si128((__m128i*) (dst + j * 4), _mm_packus_epi16(p01, p23));
+	}
+	HalveRowScalar(row0, row1, dst, srcWidth, j, dstWidth);
+}
+
+#endif
+
+// Writes the HalvedSize(width) x HalvedSize(height) reduction of src into dst.
+inline void HalveRGBA(const Uint8* src, int width, int height, Uint8* dst, PixelKernel kernel = PIXEL_KERNEL_BEST) {
+	if (kernel == PIXEL_KERNEL_BEST) {
+		kernel = BestPixelKernel();
+	}
+	const int dstWidth = HalvedSize(width), dstHeight = HalvedSize(height);
+	for (int i=0; i < dstHeight; i++) {
+		const Uint8* row0 = src + 2 * i * width * 4;
+		const Uint8* row1 = src + std::min(2 * i + 1, height - 1) * width * 4;
+		Uint8* out = dst + i * dstWidth * 4;
+		switch (kernel) {
+#ifdef PIXELS_X86
+		case PIXEL_KERNEL_AVX2:
+		case PIXEL_KERNEL_SSE2: HalveRowSSE2(row0, row1, out, width, dstWidth); break;
+#endif
+		default: HalveRowScalar(row0, row1, out, width, 0, dstWidth); break;
+		}
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <SDL.h>
+#include <GL/glew.h>
+
+// Keeps linked program binaries on disk, so that the next launch can skip compiling and
+// linking. Entries are keyed by a hash of everything that went into the program and of the
+// vendor, renderer and version strings, since a binary is only valid for the driver that
+// produced it; drivers may still reject one after an update, and the caller then links
+// from source as on a miss. Each entry also records how long the original build took, so
+// that a hit can tell how much time it saved. Disabled until Open is called, and always
+// on drivers without ARB_get_program_binary.
+struct ProgramCache {
+	std::string dir;
+	int hits;
+	int misses;
+	double msSaved;
+	ProgramCache() {
+		hits = 0;
+		misses = 0;
+		msSaved = 0.0;
+	}
+	void Open(const std::string& dir_) {
+		dir = dir_;
+#ifdef _WIN32
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+	bool Enabled() const {
+		return !dir.empty() && GLEW_ARB_get_program_binary;
+	}
+	std::string Key(const std::vector<std::string>& parts) const {
+		Uint64 hash = 14695981039346656037ULL; // 64 bit FNV-1a
+		std::vector<std::string> all(parts);
+		all.push_back((const char*) glGetString(GL_VENDOR));
+		all.push_back((const char*) glGetString(GL_RENDERER));
+		all.push_back((const char*) glGetString(GL_VERSION));
+		for (size_t i=0; i < all.size(); i++) {
+			const std::string& s = all[i];
+			for (size_t j=0; j <= s.size(); j++) { // the terminator separates the parts
+				hash ^= (unsigned char) s.c_str()[j];
+				hash *= 1099511628211ULL;
+			}
+		}
+		char key[17];
+		SDL_snprintf(key, sizeof(key), "%08x%08x", (unsigned) (hash >> 32), (unsigned) hash);
+		return key;
+	}
+	// Tries to restore program from the entry for key. Returns false on a miss, when
+	// program has to be linked from source.
+	bool Load(GLuint program, const std::string& key) {
+		if (!Enabled()) {
+			return false;
+		}
+		Uint64 start = SDL_GetPerformanceCounter();
+		std::ifstream f(Path(key), std::ios::binary);
+		Header header;
+		if (!f.read((char*) &header, sizeof(header))) {
+			misses++;
+			return false;
+		}
+		std::vector<char> binary((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		glProgramBinary(program, header.format, binary.empty() ? NULL : &binary[0], binary.size());
+		GLint status;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status != GL_TRUE) {
+			misses++;
+			return false;
+		}
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		hits++;
+		msSaved += header.buildMs - ms;
+		return true;
+	}
+	// Call before linking a program that is going to be saved.
+	void PrepareLink(GLuint program) {
+		if (Enabled()) {
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+	}
+	// Stores the freshly linked program, buildMs being the time compiling and linking took.
+	void Save(GLuint program, const std::string& key, double buildMs) {
+		if (!Enabled()) {
+			return;
+		}
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length == 0) {
+			return;
+		}
+		std::vector<char> binary(length);
+		Header header;
+		header.buildMs = buildMs;
+		glGetProgramBinary(program, length, NULL, &header.format, &binary[0]);
+		std::ofstream f(Path(key), std::ios::binary);
+		f.write((const char*) &header, sizeof(header));
+		f.write(&binary[0], binary.size());
+	}
+private:
+	struct Header {
+		double buildMs;
+		GLenum format;
+	};
+	std::string Path(const std::string& key) const {
+		return dir + "/" + key + ".bin";
+	}
+};
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <memory>
+#include <vector>
+#include <string.h>
+#include <SDL.h>
+#include <GL/glew.h>
+#include "assetloader.h"
+
+// Streams texture data to the GPU through a ring of pixel buffer objects, so that a large
+// image does not stall the frame that uploads it. Uploads are cut into bands of rows that
+// fit a buffer. Pump, called once per frame on the GL thread, maps the free buffers and
+// has the asset loader copy the next bands into them; once a copy is done, the buffer is
+// unmapped and glTexSubImage2D sources the band from it, which lets the driver transfer
+// it in the background. A fence tells when the buffer can take the next band. Without a
+// loader the copies are done in Pump. Pump leaves texture unit bindings changed.
+struct UploadQueue {
+	static const int DEFAULT_SLOTS = 3;
+	static const size_t DEFAULT_SLOT_BYTES = 4 * 1024 * 1024;
+	double megabytesPerSecond; // issued to glTexSubImage2D, over the last second
+	UploadQueue(AssetLoader* loader_ = NULL, int slotCount = DEFAULT_SLOTS, size_t slotBytes_ = DEFAULT_SLOT_BYTES) {
+		loader = loader_;
+		slotBytes = slotBytes_;
+		slots.resize(slotCount);
+		for (size_t i=0; i < slots.size(); i++) {
+			glGenBuffers(1, &slots[i].id);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slots[i].id);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, slotBytes, NULL, GL_STREAM_DRAW);
+			slots[i].capacity = slotBytes;
+			slots[i].state = FREE;
+			slots[i].fence = 0;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		megabytesPerSecond = 0.0;
+		bytesIssued = 0;
+		windowStart = SDL_GetPerformanceCounter();
+	}
+	// Queues width x height texels of pixels for the block of a texture mip level whose
+	// bottom left corner is at (x, y). Rows are bottom row first, of 4 bytes per texel for
+	// GL_RGBA and 1 for GL_RED; the queue keeps pixels alive until they have been copied.
+	void Upload(GLuint texture, int x, int y, int width, int height, GLenum format, std::shared_ptr<const std::vector<GLubyte>> pixels, int level = 0) {
+		const size_t rowBytes = width * (format == GL_RED ? 1 : 4);
+		const int bandRows = std::max(1, (int) (slotBytes / rowBytes));
+		for (int row=0; row < height; row += bandRows) {
+			Band band;
+			band.texture = texture;
+			band.level = level;
+			band.x = x;
+			band.y = y + row;
+			band.width = width;
+			band.rows = std::min(bandRows, height - row);
+			band.format = format;
+			band.pixels = pixels;
+			band.offset = row * rowBytes;
+			band.bytes = band.rows * rowBytes;
+			queue.push_back(band);
+		}
+	}
+	void Pump() {
+		for (size_t i=0; i < slots.size(); i++) {
+			Slot& slot = slots[i];
+			if (slot.state == IN_FLIGHT && glClientWaitSync(slot.fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+				glDeleteSync(slot.fence);
+				slot.fence = 0;
+				slot.state = FREE;
+			}
+			if (slot.state == COPYING && slot.copied.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				Issue(slot);
+			}
+		}
+		for (size_t i=0; i < slots.size() && !queue.empty(); i++) {
+			if (slots[i].state == FREE) {
+				StartCopy(slots[i], queue.front());
+				queue.pop_front();
+			}
+		}
+		const Uint64 now = SDL_GetPerformanceCounter();
+		const double seconds = (now - windowStart) / (double) SDL_GetPerformanceFrequency();
+		if (seconds >= 1.0) {
+			megabytesPerSecond = bytesIssued / (1024.0 * 1024.0) / seconds;
+			bytesIssued = 0;
+			windowStart = now;
+		}
+	}
+	// Bands of texture not handed to GL yet; the texture is complete for the draws issued
+	// once this is 0.
+	int Pending(GLuint texture) const {
+		int pending = 0;
+		for (auto it = queue.begin(); it != queue.end(); it++) {
+			pending += it->texture == texture ? 1 : 0;
+		}
+		for (size_t i=0; i < slots.size(); i++) {
+			pending += slots[i].state == COPYING && slots[i].band.texture == texture ? 1 : 0;
+		}
+		return pending;
+	}
+	// Bands queued, being copied or being transferred.
+	int Depth() const {
+		int depth = queue.size();
+		for (size_t i=0; i < slots.size(); i++) {
+			depth += slots[i].state != FREE ? 1 : 0;
+		}
+		return depth;
+	}
+	~UploadQueue() {
+		for (size_t i=0; i < slots.size(); i++) {
+			Slot& slot = slots[i];
+			if (slot.state == COPYING) {
+				slot.copied.wait(); // the worker is still writing to the mapping
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.id);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			}
+			if (slot.fence != 0) {
+				glDeleteSync(slot.fence);
+			}
+			glDeleteBuffers(1, &slot.id);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+private:
+	enum SlotState {
+		FREE,
+		COPYING,
+		IN_FLIGHT
+	};
+	struct Band {
+		GLuint texture;
+		int level;
+		int x, y;
+		int width;
+		int rows;
+		GLenum format;
+		std::shared_ptr<const std::vector<GLubyte>> pixels;
+		size_t offset; // in bytes, into pixels
+		size_t bytes;
+	};
+	struct Slot {
+		GLuint id;
+		size_t capacity;
+		SlotState state;
+		Band band;
+		std::shared_future<void> copied;
+		GLsync fence;
+	};
+	void StartCopy(Slot& slot, const Band& band) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.id);
+		if (band.bytes > slot.capacity) {
+			slot.capacity = band.bytes; // a single row wider than a slot
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, slot.capacity, NULL, GL_STREAM_DRAW);
+		}
+		// the fence has signaled, the previous band is no longer read from the buffer
+		GLubyte* dst = (GLubyte*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, band.bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		if (dst == NULL) {
+			// the driver could not map the buffer: upload the band from client memory, which
+			// blocks until the driver has copied it, and leave the slot free
+			glGetError();
+			TexSubImage(band, &(*band.pixels)[band.offset]);
+			bytesIssued += band.bytes;
+			return;
+		}
+		slot.band = band;
+		slot.state = COPYING;
+		std::shared_ptr<const std::vector<GLubyte>> pixels = band.pixels;
+		const size_t offset = band.offset, bytes = band.bytes;
+		auto copy = [dst, pixels, offset, bytes]() {
+			memcpy(dst, &(*pixels)[offset], bytes);
+		};
+		if (loader != NULL) {
+			slot.copied = loader->Load(copy);
+		} else {
+			std::packaged_task<void()> task(copy);
+			slot.copied = task.get_future().share();
+			task();
+		}
+	}
+	void Issue(Slot& slot) {
+		const Band& band = slot.band;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.id);
+		if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+			// the buffer contents were lost while mapped, the band still is in pixels
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			TexSubImage(band, &(*band.pixels)[band.offset]);
+		} else {
+			TexSubImage(band, 0);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // other uploads read from client memory again
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.state = IN_FLIGHT;
+		slot.band.pixels.reset();
+		bytesIssued += band.bytes;
+	}
+	// Sources the band from the bound pixel unpack buffer, or from client memory when none is.
+	void TexSubImage(const Band& band, const GLvoid* source) {
+		glBindTexture(GL_TEXTURE_2D, band.texture);
+		if (band.format == GL_RED) {
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		}
+		glTexSubImage2D(GL_TEXTURE_2D, band.level, band.x, band.y, band.width, band.rows, band.format, GL_UNSIGNED_BYTE, source);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+	AssetLoader* loader;
+	size_t slotBytes;
+	std::vector<Slot> slots;
+	std::deque<Band> queue;
+	Uint64 bytesIssued;
+	Uint64 windowStart;
+	UploadQueue(const UploadQueue&);
+};
@@ -6,15 +6,22 @@
 #include <memory>
 #include <vector>
 #include <numeric>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <string.h>
 #include <sys/stat.h>
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <GL/glew.h>
+#include "bench.h"
+#include "framepacer.h"
 
 struct App {
 	App() {
-		SDL_Init(SDL_INIT_EVERYTHING);
+		RequireSDL(SDL_Init(SDL_INIT_EVERYTHING) == 0, "SDL_Init");
 		TTF_Init();
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
@@ -27,14 +34,25 @@ struct App {
 	}
 };
 
+// A window with its own GL context, cleared in its own color. Started windows render and
+// present from a thread of their own, so that with vsync each one only waits for its own
+// swaps instead of taking turns with the others. Windows are still created, destroyed and
+// fed their events by the main thread, which owns the SDL event loop: Post queues an event
+// for the render thread, which handles it at the start of its next frame.
 struct Win {
 	SDL_Window* w;
 	SDL_GLContext ctx;
-	Win(std::string title, int width, int height) {
-		w = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL);
+	float r, g, b;
+	std::atomic<int> presented; // frames, counted by whichever thread renders
+	Win(std::string title, int width, int height, float r_, float g_, float b_) : r(r_), g(g_), b(b_) {
+		w = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+		RequireSDL(w != NULL, "SDL_CreateWindow");
 		ctx = SDL_GL_CreateContext(w);
+		RequireSDL(ctx != NULL, "SDL_GL_CreateContext");
 		glewInit(); // must be called AFTER the OpenGL context has been created
 		glViewport(0, 0, width, height);
+		presented = 0;
+		stopping = false;
 	}
 	void Show() {
 		SDL_ShowWindow(w);
@@ -42,40 +60,174 @@ struct Win {
 	void MakeCurrent() {
 		SDL_GL_MakeCurrent(w, ctx);
 	}
+	Uint32 Id() const {
+		return SDL_GetWindowID(w);
+	}
+	void Render() {
+		glClearColor(r, g, b, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	// Hands the context over to a new render thread, paced on its own like pacer.
+	void Start(const FramePacer& pacer) {
+		SDL_GL_MakeCurrent(w, NULL); // a context is current in one thread at most
+		thread = std::thread(&Win::Run, this, pacer.mode, pacer.targetHz);
+	}
+	void Post(const SDL_Event& event) {
+		std::lock_guard<std::mutex> lock(mutex);
+		events.push_back(event);
+	}
+	void Stop() {
+		stopping = true;
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
 	~Win() {
+		Stop();
 		SDL_GL_DeleteContext(ctx);
 		SDL_DestroyWindow(w);
 	}
+private:
+	void Run(PacingMode mode, double targetHz) {
+		FramePacer pacer(mode, targetHz);
+		MakeCurrent();
+		pacer.Apply();
+		while (!stopping) {
+			std::deque<SDL_Event> pending;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pending.swap(events);
+			}
+			for (auto it = pending.begin(); it != pending.end(); it++) {
+				if (it->type == SDL_WINDOWEVENT && it->window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+					glViewport(0, 0, it->window.data1, it->window.data2);
+				}
+			}
+			Render();
+			SDL_GL_SwapWindow(w);
+			pacer.Frame();
+			presented++;
+		}
+		SDL_GL_MakeCurrent(w, NULL);
+	}
+	std::thread thread;
+	std::atomic<bool> stopping;
+	std::deque<SDL_Event> events;
+	std::mutex mutex;
+	Win(const Win&);
 };
 
-
+// Renders from one thread per window by default; "--single-thread" renders every window
+// in turn from the main thread, so that the two can be compared, and "--windows <n>" sets
+// how many windows are opened. Either way the benchmark counts frames presented by any
+// window, so its fps is the total throughput.
 int main(int argc, char **argv)
 {
+	Bench bench("dblctx", argc, argv);
+	FramePacer pacer(argc, argv);
+	bool singleThread = false;
+	int windowCount = 2;
+	for (int i=1; i < argc; i++) {
+		if (std::string(argv[i]) == "--single-thread") {
+			singleThread = true;
+		}
+		if (std::string(argv[i]) == "--windows" && i + 1 < argc) {
+			windowCount = std::max(1, atoi(argv[i+1]));
+		}
+	}
 	App app;
-	Win win1("Double Context 1", 640, 480);
-	Win win2("Double Context 2", 800, 600);
-	win1.Show();
-	win2.Show();
+	const float colors[][3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 0.0f } };
+	std::vector<std::shared_ptr<Win>> wins;
+	std::map<Uint32, std::shared_ptr<Win>> winsById;
+	for (int i=0; i < windowCount; i++) {
+		std::stringstream title;
+		title << "Double Context " << i + 1;
+		const float* color = colors[i % 4];
+		std::shared_ptr<Win> win(new Win(title.str(), i % 2 == 0 ? 640 : 800, i % 2 == 0 ? 480 : 600, color[0], color[1], color[2]));
+		wins.push_back(win);
+		winsById[win->Id()] = win;
+	}
+	for (size_t i=0; i < wins.size(); i++) {
+		if (!bench.Enabled()) {
+			wins[i]->Show();
+		}
+		if (!singleThread) {
+			wins[i]->Start(pacer);
+		} else {
+			wins[i]->MakeCurrent();
+			pacer.Apply();
+		}
+	}
 
 	SDL_Event event;
     bool done = false;
+	int counted = 0;
+	Uint32 lastTitleUpdate = SDL_GetTicks();
+	std::vector<int> lastPresented(wins.size(), 0);
     while (!done) {
+		// the render threads present on their own, the main thread only waits for events
+		if (!singleThread) {
+			SDL_WaitEventTimeout(NULL, 1); // leaves the event in the queue
+		}
 		while (SDL_PollEvent(&event)) {
 			switch (event.type) {
 			case SDL_QUIT: 
 				done = true;
 				break;
+			case SDL_WINDOWEVENT: {
+				auto it = winsById.find(event.window.windowID);
+				if (it == winsById.end()) {
+					break;
+				}
+				if (singleThread) {
+					if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+						it->second->MakeCurrent();
+						glViewport(0, 0, event.window.data1, event.window.data2);
+					}
+				} else {
+					it->second->Post(event);
+				}
+				break;
+			}
             }
         }
-		win1.MakeCurrent();
-		glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		win2.MakeCurrent();
-		glClearColor(0.0f, 1.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		SDL_GL_SwapWindow(win1.w);
-		SDL_GL_SwapWindow(win2.w);
+		if (singleThread) {
+			for (size_t i=0; i < wins.size(); i++) {
+				wins[i]->MakeCurrent();
+				wins[i]->Render();
+			}
+			for (size_t i=0; i < wins.size(); i++) {
+				wins[i]->MakeCurrent(); // SDL only swaps the window whose context is current
+				SDL_GL_SwapWindow(wins[i]->w);
+				wins[i]->presented++;
+			}
+			pacer.Frame();
+		}
+		int total = 0;
+		for (size_t i=0; i < wins.size(); i++) {
+			total += wins[i]->presented;
+		}
+		for (; counted < total && !done; counted++) {
+			if (!bench.Frame()) {
+				done = true;
+			}
+		}
+		// each window shows its own frame rate, which no longer depends on the others
+		Uint32 now = SDL_GetTicks();
+		if (now - lastTitleUpdate >= 1000) {
+			for (size_t i=0; i < wins.size(); i++) {
+				int frames = wins[i]->presented;
+				std::stringstream title;
+				title << "Double Context " << i + 1 << " - " << (frames - lastPresented[i]) * 1000 / (now - lastTitleUpdate) << " FPS";
+				SDL_SetWindowTitle(wins[i]->w, title.str().c_str());
+				lastPresented[i] = frames;
+			}
+			lastTitleUpdate = now;
+		}
     }
+	for (size_t i=0; i < wins.size(); i++) {
+		wins[i]->Stop();
+	}
 
     return 0;
 }
@@ -5,23 +5,255 @@
 #include <map>
 #include <memory>
 #include <vector>
-#include <numeric>
+#include <deque>
+#include <tuple>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <string.h>
 #include <sys/stat.h>
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <GL/glew.h>
+#include "archive.h"
+#include "assetloader.h"
+#include "bench.h"
+#include "fontatlas.h"
+#include "framepacer.h"
+#include "framestats.h"
+#include "gputimer.h"
+#include "matrix.h"
+#include "pixels.h"
+#include "programcache.h"
 
 // Up to 16 attributes per vertex is allowed so any value between 0 and 15 will do.
 const int POSITION_ATTRIBUTE_INDEX = 12;
 const int TEXCOORD_ATTRIBUTE_INDEX = 7;
+// per instance attributes of the sprite batch
+const int SPRITE_RECT_ATTRIBUTE_INDEX = 1;
+const int SPRITE_UV_ATTRIBUTE_INDEX = 2;
+const int SPRITE_COLOR_ATTRIBUTE_INDEX = 3;
+
+// Counts the expensive GL operations issued during the current frame.
+struct FrameCounters {
+	int drawCalls;
+	int bufferAllocations;
+	long bytesStreamed;
+	int streamStalls;
+	int stateCallsIssued;
+	int stateCallsElided;
+	FrameCounters() {
+		Reset();
+	}
+	void Reset() {
+		drawCalls = 0;
+		bufferAllocations = 0;
+		bytesStreamed = 0;
+		streamStalls = 0;
+		stateCallsIssued = 0;
+		stateCallsElided = 0;
+	}
+};
+
+FrameCounters frameCounters;
+
+// Shadows the bits of GL state we change all the time so that binds which would not
+// change anything are skipped. Every program, texture unit, array buffer and vertex
+// array change has to go through here, otherwise the shadow copy goes stale.
+struct GLState {
+	static const int TEXTURE_UNITS = 16;
+	GLuint program;
+	int activeTexture;
+	GLuint textures[TEXTURE_UNITS];
+	GLuint arrayBuffer;
+	GLuint vertexArray;
+	GLState() {
+		program = 0;
+		activeTexture = 0;
+		for (int i=0; i < TEXTURE_UNITS; i++) {
+			textures[i] = 0;
+		}
+		arrayBuffer = 0;
+		vertexArray = 0;
+	}
+	void UseProgram(GLuint id) {
+		if (Changed(program, id)) {
+			glUseProgram(id);
+		}
+	}
+	void BindTexture(int unit, GLuint id) {
+		if (textures[unit] == id) {
+			frameCounters.stateCallsElided++;
+			return;
+		}
+		if (Changed(activeTexture, unit)) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+		textures[unit] = id;
+		frameCounters.stateCallsIssued++;
+		glBindTexture(GL_TEXTURE_2D, id);
+	}
+	void BindArrayBuffer(GLuint id) {
+		if (Changed(arrayBuffer, id)) {
+			glBindBuffer(GL_ARRAY_BUFFER, id);
+		}
+	}
+	void BindVertexArray(GLuint id) {
+		if (Changed(vertexArray, id)) {
+			glBindVertexArray(id);
+		}
+	}
+	// Deleting a bound object resets the binding to 0.
+	void DeleteBuffer(GLuint id) {
+		if (arrayBuffer == id) {
+			arrayBuffer = 0;
+		}
+		glDeleteBuffers(1, &id);
+	}
+	void DeleteVertexArray(GLuint id) {
+		if (vertexArray == id) {
+			vertexArray = 0;
+		}
+		glDeleteVertexArrays(1, &id);
+	}
+	void DeleteTexture(GLuint id) {
+		for (int i=0; i < TEXTURE_UNITS; i++) {
+			if (textures[i] == id) {
+				textures[i] = 0;
+			}
+		}
+		glDeleteTextures(1, &id);
+	}
+private:
+	template <class T>
+	bool Changed(T& current, T value) {
+		if (current == value) {
+			frameCounters.stateCallsElided++;
+			return false;
+		}
+		current = value;
+		frameCounters.stateCallsIssued++;
+		return true;
+	}
+};
+
+GLState glState;
+
+// One large vertex buffer used as a ring: dynamic data is written at the head with
+// unsynchronized mapping, and each frame's region is protected by a fence until the
+// GPU is done with it. Waiting on a fence that has not signaled yet counts as a stall.
+// The ring grows, orphaning its storage, to hold a few frames as large as the largest
+// one; when fences are not available, the storage is orphaned whenever it is full.
+struct StreamBuffer {
+	GLuint id;
+	GLsizeiptr size;
+	GLintptr head;
+	GLsizeiptr inUse;
+	GLsizeiptr frameBytes;
+	struct Frame {
+		GLsync fence;
+		GLsizeiptr bytes;
+	};
+	std::deque<Frame> frames;
+	StreamBuffer(GLsizeiptr size_) {
+		size = size_;
+		head = 0;
+		inUse = 0;
+		frameBytes = 0;
+		glGenBuffers(1, &id);
+		glState.BindArrayBuffer(id);
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	}
+	// Copies the data into the ring and returns its offset. The buffer is left bound to GL_ARRAY_BUFFER.
+	GLintptr Write(const void* data, GLsizeiptr bytes) {
+		glState.BindArrayBuffer(id);
+		GLintptr offset = Allocate(bytes);
+		void* dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (dst != NULL) {
+			memcpy(dst, data, bytes);
+		}
+		// a failed map, or an unmap reporting the contents lost, falls back to a plain copy
+		if (dst == NULL || glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+			glGetError(); // the failed map raised an error the frame has now dealt with
+			glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
+		}
+		frameCounters.bytesStreamed += bytes;
+		return offset;
+	}
+	// Must be called once all the draws sourcing this frame's data have been issued.
+	void EndFrame() {
+		if (frameBytes == 0) {
+			return;
+		}
+		Frame frame;
+		frame.fence = GLEW_ARB_sync ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+		frame.bytes = frameBytes;
+		frames.push_back(frame);
+		frameBytes = 0;
+	}
+	~StreamBuffer() {
+		for (auto it = frames.begin(); it != frames.end(); it++) {
+			glDeleteSync(it->fence);
+		}
+		glState.DeleteBuffer(id);
+	}
+private:
+	static const GLsizeiptr ALIGNMENT = 16;
+	static const int FRAMES_IN_FLIGHT = 3;
+	GLintptr Allocate(GLsizeiptr bytes) {
+		bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		if ((frameBytes + bytes) * FRAMES_IN_FLIGHT > size) {
+			// the ring cannot hold this frame while the GPU still reads the previous ones,
+			// so every frame would wait on a fence; grow it
+			while (size < (frameBytes + bytes) * FRAMES_IN_FLIGHT) {
+				size *= 2;
+			}
+			Orphan();
+		}
+		// skip the tail end of the buffer when the data does not fit before wrapping
+		GLsizeiptr padding = head + bytes > size ? size - head : 0;
+		while (size - inUse < padding + bytes) {
+			if (frames.empty() || frames.front().fence == 0) {
+				Orphan();
+				padding = 0;
+				break;
+			}
+			Frame& oldest = frames.front();
+			if (glClientWaitSync(oldest.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+				frameCounters.streamStalls++;
+				glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			}
+			glDeleteSync(oldest.fence);
+			inUse -= oldest.bytes;
+			frames.pop_front();
+		}
+		GLintptr offset = (head + padding) % size;
+		head = (offset + bytes) % size;
+		inUse += padding + bytes;
+		frameBytes += padding + bytes;
+		return offset;
+	}
+	void Orphan() {
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+		for (auto it = frames.begin(); it != frames.end(); it++) {
+			glDeleteSync(it->fence);
+		}
+		frames.clear();
+		head = 0;
+		inUse = 0;
+		frameBytes = 0;
+	}
+	StreamBuffer(const StreamBuffer&);
+};
 
 struct App {
 	App() {
-		SDL_Init(SDL_INIT_EVERYTHING);
+		RequireSDL(SDL_Init(SDL_INIT_EVERYTHING) == 0, "SDL_Init");
 		TTF_Init();
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
 		SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 	}
@@ -36,8 +268,12 @@ struct Win {
 	SDL_GLContext ctx;
 	Win(std::string title, int width, int height) {
 		w = SDL_CreateWindow(title.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL);
+		RequireSDL(w != NULL, "SDL_CreateWindow");
 		ctx = SDL_GL_CreateContext(w);
+		RequireSDL(ctx != NULL, "SDL_GL_CreateContext");
+		glewExperimental = GL_TRUE; // otherwise GLEW skips the entry points missing from the core profile extension string
 		glewInit(); // must be called AFTER the OpenGL context has been created
+		glGetError(); // glewInit raises GL_INVALID_ENUM on core contexts
 		glViewport(0, 0, width, height);
 	}
 	void Show() {
@@ -49,95 +285,184 @@ struct Win {
 	}
 };
 
-std::string	readTextFile(const std::string& filename) {
-	std::ifstream f(filename);
-	std::stringstream buffer;
-	buffer << f.rdbuf();
-	return buffer.str();
-}
+// Mapped from "../assets.pak" at startup, when it has been packed.
+Archive archive;
 
-template <class T>
-struct Matrix44
-{
-	T m[16];
-};
+// Files queued on the asset loader at startup; readTextFile waits for them instead of
+// reading them again.
+std::map<std::string, std::shared_future<std::string>> preloadedTextFiles;
 
-template <class T>
-Matrix44<T> Ortho(T right, T left, T top, T bottom, T nearp, T farp) {
-	Matrix44<T> mat;
-	mat.m[0] = 2 / (right - left);
-	mat.m[1] = 0.0f;
-	mat.m[2] = 0.0f;
-	mat.m[3] = 0.0f;
-	mat.m[4] = 0.0f;
-	mat.m[5] = 2 / (top - bottom);
-	mat.m[6] = 0.0f;
-	mat.m[7] = 0.0f;
-	mat.m[8] = 0.0f;
-	mat.m[9] = 0.0f;
-	mat.m[10] = 2 / (farp - nearp);
-	mat.m[11] = 0.0f;
-	mat.m[12] = -(right + left) / (right - left);
-	mat.m[13] = -(top + bottom) / (top - bottom);
-	mat.m[14] = -(farp + nearp) / (farp - nearp);
-	mat.m[15] = 1.0f;
-	return mat;
+std::string	readTextFile(const std::string& filename) {
+	auto it = preloadedTextFiles.find(filename);
+	if (it != preloadedTextFiles.end()) {
+		return it->second.get();
+	}
+	return archive.ReadText(filename);
 }
 
+// Vertices are stored interleaved in a single buffer, three position floats optionally
+// followed by two texture coordinate floats, and described once by a vertex array object.
+// Geometry with an index buffer is drawn with glDrawElements, otherwise with glDrawArrays.
 struct Geometry {
-	GLuint positionsId;
-	GLuint texCoordsId;
-	Geometry() {
-		positionsId = 0;
-        texCoordsId = 0;
-	}
-	void SetVertexPositions(void* data, long size) {
-		glGenBuffers(1, &positionsId);
-		glBindBuffer(GL_ARRAY_BUFFER, positionsId);
-		glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
-	}
-    void SetVertexTexCoords(void* data, long size) {
-		glGenBuffers(1, &texCoordsId);
-		glBindBuffer(GL_ARRAY_BUFFER, texCoordsId);
-		glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
-    }
+	GLuint vertexArrayId;
+	GLuint verticesId;
+	GLuint indicesId;
+	bool texCoords;
+	bool streamed;
+	int vertexCount;
+	int indexCount;
+	int indexCapacity;
+	Geometry(bool texCoords_ = false) {
+		glGenVertexArrays(1, &vertexArrayId);
+		verticesId = 0;
+		indicesId = 0;
+		texCoords = texCoords_;
+		streamed = false;
+		vertexCount = 0;
+		indexCount = 0;
+		indexCapacity = 0;
+	}
+	int Stride() const {
+		return (texCoords ? 5 : 3) * sizeof(float);
+	}
+	// The buffer is created on first use and its storage is respecified afterwards,
+	// so geometry rebuilt every frame should pass GL_STREAM_DRAW or use StreamVertices.
+	void SetVertices(const void* data, long size, GLenum usage = GL_STATIC_DRAW) {
+		glState.BindVertexArray(vertexArrayId);
+		if (verticesId == 0) {
+			glGenBuffers(1, &verticesId);
+			frameCounters.bufferAllocations++;
+		}
+		glState.BindArrayBuffer(verticesId);
+		glBufferData(GL_ARRAY_BUFFER, size, data, usage);
+		SetAttributePointers(0);
+		vertexCount = size / Stride();
+	}
+	// Sources the vertices from a region of the stream buffer, valid for the current frame only.
+	void StreamVertices(StreamBuffer& stream, const void* data, long size) {
+		streamed = true;
+		glState.BindVertexArray(vertexArrayId);
+		GLintptr offset = stream.Write(data, size);
+		SetAttributePointers(offset);
+		vertexCount = size / Stride();
+	}
+	void SetIndices(const GLuint* data, int count) {
+		glState.BindVertexArray(vertexArrayId);
+		if (indicesId == 0) {
+			glGenBuffers(1, &indicesId);
+			frameCounters.bufferAllocations++;
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indicesId); // part of the vertex array state
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(GLuint), data, GL_STATIC_DRAW);
+		indexCount = count;
+		indexCapacity = count;
+	}
+	// Indexes the first quadCount quads, given as four counter-clockwise vertices each,
+	// as two triangles. The index buffer only grows, so this is cheap to call every frame.
+	void SetQuadIndices(int quadCount) {
+		if (quadCount * 6 > indexCapacity) {
+			std::vector<GLuint> indices;
+			indices.reserve(quadCount * 6);
+			for (int i=0; i < quadCount; i++) {
+				GLuint quad[] = { 0, 1, 2, 0, 2, 3 };
+				for (int j=0; j < 6; j++) {
+					indices.push_back(i * 4 + quad[j]);
+				}
+			}
+			SetIndices(&indices[0], indices.size());
+		}
+		indexCount = quadCount * 6;
+	}
+	void Draw(GLenum mode) const {
+		glState.BindVertexArray(vertexArrayId);
+		if (indicesId != 0) {
+			glDrawElements(mode, indexCount, GL_UNSIGNED_INT, 0);
+		} else {
+			glDrawArrays(mode, 0, vertexCount);
+		}
+		frameCounters.drawCalls++;
+	}
 	~Geometry() {
-		glDeleteBuffers(1, &positionsId);
-		glDeleteBuffers(1, &texCoordsId);
+		if (!streamed) {
+			glState.DeleteBuffer(verticesId);
+		}
+		glState.DeleteBuffer(indicesId);
+		glState.DeleteVertexArray(vertexArrayId);
 	}
+private:
+	// expects the vertex array and the vertex buffer to be bound
+	void SetAttributePointers(GLintptr offset) {
+		glEnableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
+		glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, Stride(), (void*) offset);
+		if (texCoords) {
+			glEnableVertexAttribArray(TEXCOORD_ATTRIBUTE_INDEX);
+			glVertexAttribPointer(TEXCOORD_ATTRIBUTE_INDEX, 2, GL_FLOAT, GL_FALSE, Stride(), (void*) (offset + 3 * sizeof(float)));
+		}
+	}
+	Geometry(const Geometry&);
 };
 
 struct Texture {
 	GLuint id;
 	int width;
 	int height;
+	GLenum format;
 	Texture() {}
 	Texture(SDL_Surface* s) {
 		width = s->w;
 		height = s->h;
-		SDL_Palette* palette = s->format->palette;
-		char* p = (char*) s->pixels;
+		format = GL_RGBA;
 		GLubyte* data = new GLubyte[s->w * s->h * 4];
-		GLubyte* t = data;
-		for (int i=s->h-1; i >= 0; i--) {
-			for (int j=0; j < s->w; j++) {
-				SDL_Color color = palette->colors[p[i*s->pitch+j]];
-				*t++ = color.r;
-				*t++ = color.g;
-				*t++ = color.b;
-				*t++ = 255;
-			}
+		SurfaceToRGBA(s, data, s->w * 4);
+		Upload(data);
+		delete[] data;
+	}
+	// data is expected bottom row first, in RGBA order or, for GL_RED, as one coverage
+	// byte per pixel that is stored as GL_R8
+	Texture(int width_, int height_, const GLubyte* data, GLenum format_ = GL_RGBA) {
+		width = width_;
+		height = height_;
+		format = format_;
+		Upload(data);
+	}
+	// Replaces a w x h block of texels whose bottom left corner is at (x, y), data being
+	// in the same layout as for the constructor.
+	void Update(int x, int y, int w, int h, const GLubyte* data) {
+		glState.BindTexture(0, id);
+		if (format == GL_RED) {
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RED, GL_UNSIGNED_BYTE, data);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		} else {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data);
 		}
+	}
+	// For textures drawn smaller than they are: minification then blends the two nearest
+	// of the levels made here instead of skipping texels, which shimmers as things move.
+	void GenerateMipmaps() {
+		glState.BindTexture(0, id);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	}
+	~Texture() {
+		glState.DeleteTexture(id);
+	}
+private:
+	void Upload(const GLubyte* data) {
 		glGenTextures(1, &id);
-		glBindTexture(GL_TEXTURE_2D, id);
+		glState.BindTexture(0, id);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, s->w, s->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-	}
-	~Texture() {
-		glDeleteTextures(1, &id);
+		if (format == GL_RED) {
+			// single byte rows are not padded to 4 bytes
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		}
 	}
 };
 
@@ -150,6 +475,16 @@ struct Shader {
 		const GLint length = source.length();
 		glShaderSource(id, 1, &str, &length);
 		glCompileShader(id);
+		GLint status;
+		glGetShaderiv(id, GL_COMPILE_STATUS, &status);
+		if (status != GL_TRUE) {
+			GLint logLength;
+			glGetShaderiv(id, GL_INFO_LOG_LENGTH, &logLength);
+			std::vector<GLchar> log(logLength + 1, 0);
+			glGetShaderInfoLog(id, logLength, NULL, &log[0]);
+			std::cout << "Shader compilation failed:" << std::endl << &log[0] << std::endl;
+			exit(EXIT_FAILURE);
+		}
 	}
 	~Shader() {
 		glDeleteShader(id);
@@ -158,44 +493,143 @@ private:
     Shader(const Shader&);
 };
 
+// An active uniform or attribute, as reported by the driver once the program is linked.
+struct ProgramVariable {
+	std::string name;
+	GLint location;
+	GLenum type;
+	GLint size;
+};
+
+// Uniforms are looked up by name once, when the program is created, and then set
+// through their index in the uniforms table.
+typedef int UniformHandle;
+const UniformHandle NO_UNIFORM = -1;
+
+// Opt-in with "--program-cache <dir>".
+ProgramCache programCache;
+
 struct Program {
     GLuint id;
-    Shader<GL_VERTEX_SHADER> vertexShader;
-    Shader<GL_FRAGMENT_SHADER> fragmentShader;
+	std::vector<ProgramVariable> uniforms;
+	std::vector<ProgramVariable> attributes;
 	Program(const std::string& vertexShaderSource,
 			const std::string& fragmentShaderSource,
             const std::map<int, std::string>& attributeIndices)
-    :
-        vertexShader(vertexShaderSource),
-        fragmentShader(fragmentShaderSource)
 	{
 		id = glCreateProgram();
+		std::vector<std::string> cacheKeyParts;
+		cacheKeyParts.push_back(vertexShaderSource);
+		cacheKeyParts.push_back(fragmentShaderSource);
+		for (auto it = attributeIndices.begin(); it != attributeIndices.end(); it++) {
+			std::stringstream binding;
+			binding << it->first << "=" << it->second;
+			cacheKeyParts.push_back(binding.str());
+		}
+		std::string cacheKey = programCache.Key(cacheKeyParts);
+		if (!programCache.Load(id, cacheKey)) {
+			Link(vertexShaderSource, fragmentShaderSource, attributeIndices, cacheKey);
+		}
+		Reflect();
+	}
+	UniformHandle Uniform(const std::string& name) const {
+		for (size_t i=0; i < uniforms.size(); i++) {
+			if (uniforms[i].name == name) {
+				return i;
+			}
+		}
+		return NO_UNIFORM; // not declared, or optimized away by the compiler
+	}
+	void SetUniform(UniformHandle handle, const Matrix44<float>& mat) {
+		if (handle != NO_UNIFORM) {
+			SDL_assert(uniforms[handle].type == GL_FLOAT_MAT4);
+			glUniformMatrix4fv(uniforms[handle].location, 1, false, mat.m);
+		}
+	}
+	void SetUniform(UniformHandle handle, float x, float y, float z, float w) {
+		if (handle != NO_UNIFORM) {
+			SDL_assert(uniforms[handle].type == GL_FLOAT_VEC4);
+			glUniform4f(uniforms[handle].location, x, y, z, w);
+		}
+	}
+	void SetUniform(UniformHandle handle, int value) {
+		if (handle != NO_UNIFORM) {
+			SDL_assert(uniforms[handle].type == GL_INT || uniforms[handle].type == GL_SAMPLER_2D);
+			glUniform1i(uniforms[handle].location, value);
+		}
+	}
+	~Program() {
+		glDeleteProgram(id);
+	}
+private:
+	void Link(const std::string& vertexShaderSource,
+			const std::string& fragmentShaderSource,
+            const std::map<int, std::string>& attributeIndices,
+			const std::string& cacheKey) {
+		Uint64 start = SDL_GetPerformanceCounter();
+		Shader<GL_VERTEX_SHADER> vertexShader(vertexShaderSource);
+		Shader<GL_FRAGMENT_SHADER> fragmentShader(fragmentShaderSource);
 		glAttachShader(id, vertexShader.id);
 		glAttachShader(id, fragmentShader.id);
 		for (auto it = attributeIndices.begin(); it != attributeIndices.end(); it++) {
 			glBindAttribLocation(id, it->first, it->second.c_str());
 		}
+		programCache.PrepareLink(id);
 	    glLinkProgram(id);
+		GLint status;
+		glGetProgramiv(id, GL_LINK_STATUS, &status);
+		if (status != GL_TRUE) {
+			GLint logLength;
+			glGetProgramiv(id, GL_INFO_LOG_LENGTH, &logLength);
+			std::vector<GLchar> log(logLength + 1, 0);
+			glGetProgramInfoLog(id, logLength, NULL, &log[0]);
+			std::cout << "Program link failed:" << std::endl << &log[0] << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		// the shaders are only flagged for deletion while they stay attached
+		glDetachShader(id, vertexShader.id);
+		glDetachShader(id, fragmentShader.id);
+		double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		programCache.Save(id, cacheKey, ms);
 	}
-	~Program() {
-		glDeleteProgram(id);
+	void Reflect() {
+		GLint count, maxLength;
+		glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<GLchar> name(maxLength + 1);
+		for (GLint i=0; i < count; i++) {
+			ProgramVariable v;
+			glGetActiveUniform(id, i, name.size(), NULL, &v.size, &v.type, &name[0]);
+			v.name = BaseName(&name[0]);
+			v.location = glGetUniformLocation(id, &name[0]);
+			uniforms.push_back(v);
+		}
+		glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &count);
+		glGetProgramiv(id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+		name.resize(maxLength + 1);
+		for (GLint i=0; i < count; i++) {
+			ProgramVariable v;
+			glGetActiveAttrib(id, i, name.size(), NULL, &v.size, &v.type, &name[0]);
+			v.name = BaseName(&name[0]);
+			v.location = glGetAttribLocation(id, &name[0]);
+			attributes.push_back(v);
+		}
+	}
+	// arrays are reported as "name[0]"
+	static std::string BaseName(const std::string& name) {
+		return name.substr(0, name.find('['));
 	}
-private:
     Program(const Program& that);
 };
 
 struct MonochromeProgram : public Program {
+	UniformHandle mvpMatrixUniform;
+	UniformHandle colorUniform;
 	void Render(const Geometry& geometry, const Matrix44<float>& mat) {
-		glUseProgram(id);
-		GLuint matrixUniform = glGetUniformLocation(id, "mvpMatrix");
-		glUniformMatrix4fv(matrixUniform, 1, false, mat.m);
-		GLuint color = glGetUniformLocation(id, "color");
-		glUniform4f(color, 1.0f, 1.0f, 0.0f, 0.7f);
-		glEnableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
-		glBindBuffer(GL_ARRAY_BUFFER, geometry.positionsId);
-		glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glDrawArrays(GL_LINES, 0, 4);
-		glDisableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
+		glState.UseProgram(id);
+		SetUniform(mvpMatrixUniform, mat);
+		SetUniform(colorUniform, 1.0f, 1.0f, 0.0f, 0.7f);
+		geometry.Draw(GL_LINES);
 	}
     static std::shared_ptr<MonochromeProgram> Create() {
 	    std::map<int, std::string> monochromeAttributeIndices;
@@ -204,103 +638,743 @@ struct MonochromeProgram : public Program {
     }
 private:
     MonochromeProgram(const std::map<int, std::string>& attributeIndices)
-	: Program(readTextFile("monochrome.vert"), readTextFile("monochrome.frag"), attributeIndices) {}
+	: Program(readTextFile("monochrome.vert"), readTextFile("monochrome.frag"), attributeIndices) {
+		mvpMatrixUniform = Uniform("mvpMatrix");
+		colorUniform = Uniform("color");
+	}
 };
 
-struct TextureProgram : public Program {
-	void Render(const Geometry& geometry, const Texture& texture, const Matrix44<float>& mat) {
-		glUseProgram(id);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture.id);
-		GLuint matrixUniform = glGetUniformLocation(id, "mvpMatrix");
-		glUniformMatrix4fv(matrixUniform, 1, false, mat.m);
-		GLuint textureUniform = glGetUniformLocation(id, "texture");
-		glUniform1i(textureUniform, 0); // we pass the texture unit
-		glEnableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
-        glBindBuffer(GL_ARRAY_BUFFER, geometry.positionsId);
-		glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(TEXCOORD_ATTRIBUTE_INDEX);
-        glBindBuffer(GL_ARRAY_BUFFER, geometry.texCoordsId);
-		glVertexAttribPointer(TEXCOORD_ATTRIBUTE_INDEX, 2, GL_FLOAT, GL_FALSE, 0, 0);
-		glDrawArrays(GL_QUADS, 0, 4);
-		glDisableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
-		glDisableVertexAttribArray(TEXCOORD_ATTRIBUTE_INDEX);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-	}
-    static std::shared_ptr<TextureProgram> Create() {
-	    std::map<int, std::string> textureAttributeIndices;
-	    textureAttributeIndices[POSITION_ATTRIBUTE_INDEX] = "pos";
-	    textureAttributeIndices[TEXCOORD_ATTRIBUTE_INDEX] = "texCoord";
-        return std::shared_ptr<TextureProgram>(new TextureProgram(textureAttributeIndices));
+struct Color {
+	float r, g, b, a;
+	Color(float r_ = 1.0f, float g_ = 1.0f, float b_ = 1.0f, float a_ = 1.0f) : r(r_), g(g_), b(b_), a(a_) {}
+	bool operator!=(const Color& that) const {
+		return r != that.r || g != that.g || b != that.b || a != that.a;
+	}
+};
+
+// Draws single channel coverage textures, such as the font atlas, in a uniform color.
+// The distance field flavour thresholds distance field atlases instead.
+struct TextProgram : public Program {
+	UniformHandle mvpMatrixUniform;
+	UniformHandle colorUniform;
+	void Render(const Geometry& geometry, const Texture& texture, const Color& color, const Matrix44<float>& mat) {
+		glState.UseProgram(id);
+		glState.BindTexture(0, texture.id);
+		SetUniform(mvpMatrixUniform, mat);
+		SetUniform(colorUniform, color.r, color.g, color.b, color.a);
+		geometry.Draw(GL_TRIANGLES);
+	}
+    static std::shared_ptr<TextProgram> Create(bool distanceField) {
+	    std::map<int, std::string> textAttributeIndices;
+	    textAttributeIndices[POSITION_ATTRIBUTE_INDEX] = "pos";
+	    textAttributeIndices[TEXCOORD_ATTRIBUTE_INDEX] = "texCoord";
+        return std::shared_ptr<TextProgram>(new TextProgram(distanceField ? "sdf.frag" : "text.frag", textAttributeIndices));
+    }
+private:
+	TextProgram(const std::string& fragmentShader, std::map<int, std::string>& attributeIndices)
+	: Program(readTextFile("texture.vert"), readTextFile(fragmentShader), attributeIndices) {
+		mvpMatrixUniform = Uniform("mvpMatrix");
+		colorUniform = Uniform("color");
+		glState.UseProgram(id);
+		SetUniform(Uniform("tex"), 0); // the texture is always bound to unit 0
+	}
+};
+
+// Draws sprites, textured and tinted quads whose corners come from the vertex index, from
+// per instance attributes.
+struct SpriteProgram : public Program {
+	UniformHandle mvpMatrixUniform;
+	void Use(const Matrix44<float>& mat) {
+		glState.UseProgram(id);
+		SetUniform(mvpMatrixUniform, mat);
+	}
+    static std::shared_ptr<SpriteProgram> Create() {
+	    std::map<int, std::string> spriteAttributeIndices;
+	    spriteAttributeIndices[SPRITE_RECT_ATTRIBUTE_INDEX] = "rect";
+	    spriteAttributeIndices[SPRITE_UV_ATTRIBUTE_INDEX] = "uvRect";
+	    spriteAttributeIndices[SPRITE_COLOR_ATTRIBUTE_INDEX] = "color";
+        return std::shared_ptr<SpriteProgram>(new SpriteProgram(spriteAttributeIndices));
     }
 private:
-	TextureProgram(std::map<int, std::string>& attributeIndices)
-	: Program(readTextFile("texture.vert"), readTextFile("texture.frag"), attributeIndices) {}
+	SpriteProgram(std::map<int, std::string>& attributeIndices)
+	: Program(readTextFile("sprite.vert"), readTextFile("sprite.frag"), attributeIndices) {
+		mvpMatrixUniform = Uniform("mvpMatrix");
+		glState.UseProgram(id);
+		SetUniform(Uniform("tex"), 0); // the texture is always bound to unit 0
+	}
+};
+
+// Queues sprites with Submit and draws them all in Flush, back to front by depth and,
+// within a depth, grouped by texture. The sorted sprites go to the stream buffer in one
+// write, as one instance each, and every run of sprites sharing a texture is a single
+// instanced draw of a four vertex strip, so a frame of sprites costs about one draw call
+// per texture and depth. Sprites of the same depth are not drawn in submission order:
+// sprites that overlap should not share a depth.
+struct SpriteBatch {
+	struct Instance {
+		float x, y, width, height; // in pixels
+		float u0, v0, u1, v1;
+		GLubyte r, g, b, a;
+	};
+	StreamBuffer& stream;
+	std::shared_ptr<SpriteProgram> spriteProgram;
+	GLuint vertexArrayId;
+	int lastDrawCalls;
+	SpriteBatch(StreamBuffer& stream_) : stream(stream_) {
+		spriteProgram = SpriteProgram::Create();
+		glGenVertexArrays(1, &vertexArrayId);
+		glState.BindVertexArray(vertexArrayId);
+		glEnableVertexAttribArray(SPRITE_RECT_ATTRIBUTE_INDEX);
+		glEnableVertexAttribArray(SPRITE_UV_ATTRIBUTE_INDEX);
+		glEnableVertexAttribArray(SPRITE_COLOR_ATTRIBUTE_INDEX);
+		glVertexAttribDivisor(SPRITE_RECT_ATTRIBUTE_INDEX, 1);
+		glVertexAttribDivisor(SPRITE_UV_ATTRIBUTE_INDEX, 1);
+		glVertexAttribDivisor(SPRITE_COLOR_ATTRIBUTE_INDEX, 1);
+		lastDrawCalls = 0;
+	}
+	// The rectangle is in pixels from the bottom left corner of the window, the texture
+	// coordinates are normalized, and larger depths are farther away.
+	void Submit(const Texture& texture, float x, float y, float width, float height,
+			float u0, float v0, float u1, float v1, const Color& color = Color(), float depth = 0.0f) {
+		Instance instance = {
+			x, y, width, height,
+			u0, v0, u1, v1,
+			Channel(color.r), Channel(color.g), Channel(color.b), Channel(color.a)
+		};
+		instances.push_back(instance);
+		keys.push_back(std::make_pair((Uint64) DepthKey(depth) << 32 | texture.id, (Uint32) keys.size()));
+	}
+	void Flush(const Matrix44<float>& mat) {
+		lastDrawCalls = 0;
+		if (instances.empty()) {
+			return;
+		}
+		// sorting the keys rather than the sprites; the index makes it stable
+		std::sort(keys.begin(), keys.end());
+		sorted.resize(instances.size());
+		for (size_t i=0; i < keys.size(); i++) {
+			sorted[i] = instances[keys[i].second];
+		}
+		GLintptr offset = stream.Write(&sorted[0], sorted.size() * sizeof(Instance));
+		spriteProgram->Use(mat);
+		glState.BindVertexArray(vertexArrayId);
+		size_t begin = 0;
+		for (size_t i=1; i <= keys.size(); i++) {
+			// runs only break on texture changes, a texture carrying on at the next depth merges
+			GLuint texture = (GLuint) keys[begin].first;
+			if (i < keys.size() && (GLuint) keys[i].first == texture) {
+				continue;
+			}
+			glState.BindTexture(0, texture);
+			SetInstancePointers(offset + begin * sizeof(Instance));
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, i - begin);
+			frameCounters.drawCalls++;
+			lastDrawCalls++;
+			begin = i;
+		}
+		instances.clear();
+		keys.clear();
+	}
+	~SpriteBatch() {
+		glState.DeleteVertexArray(vertexArrayId);
+	}
+private:
+	// expects the vertex array and the stream buffer to be bound
+	void SetInstancePointers(GLintptr offset) {
+		glVertexAttribPointer(SPRITE_RECT_ATTRIBUTE_INDEX, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*) offset);
+		glVertexAttribPointer(SPRITE_UV_ATTRIBUTE_INDEX, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*) (offset + 4 * sizeof(float)));
+		glVertexAttribPointer(SPRITE_COLOR_ATTRIBUTE_INDEX, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void*) (offset + 8 * sizeof(float)));
+	}
+	static GLubyte Channel(float c) {
+		return (GLubyte) (std::min(1.0f, std::max(0.0f, c)) * 255.0f + 0.5f);
+	}
+	// orders the float bits, then flips them so that the farthest sprites come first
+	static Uint32 DepthKey(float depth) {
+		Uint32 bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		bits = bits & 0x80000000 ? ~bits : bits | 0x80000000;
+		return ~bits;
+	}
+	std::vector<Instance> instances;
+	std::vector<std::pair<Uint64, Uint32>> keys; // (depth << 32 | texture, index in instances)
+	std::vector<Instance> sorted;
+	SpriteBatch(const SpriteBatch&);
+};
+
+// Rasterizes the glyphs of a font the first time they are asked for, so that text in any
+// script only costs the glyphs it actually uses. Glyphs live in fixed size cells of a
+// single channel texture, which starts with one row of cells and doubles its height as
+// they fill up, until it reaches the memory budget. From then on, a new glyph takes the
+// cell of the least recently used one; glyphs used during the current frame are never
+// evicted, since text referring to them may still be waiting to be drawn, and when every
+// cell is in use the new glyph is dropped instead. Glyphs wider than a cell are reported
+// once and kept as blank space of their advance. Rows are added at the top of the
+// texture, so growing it does not move the glyphs already in it. Each eviction bumps the
+// epoch, which tells the holders of laid out text that it may now point at other glyphs.
+struct GlyphCache {
+	static const int WIDTH = 512;
+	TTF_Font* font;
+	std::shared_ptr<Texture> texture;
+	std::vector<GLubyte> pixels; // a copy of the texture, to grow it
+	int cellSize;
+	int columns;
+	int maxRows;
+	int epoch;
+	int misses;
+	int evictions;
+	int dropped;
+	GlyphCache(TTF_Font* font_, size_t budgetBytes) {
+		font = font_;
+		cellSize = TTF_FontHeight(font) + 2 * FontAtlas::PADDING;
+		columns = WIDTH / cellSize;
+		maxRows = std::max(1, (int) (budgetBytes / (WIDTH * cellSize)));
+		frame = 0;
+		epoch = 0;
+		misses = 0;
+		evictions = 0;
+		dropped = 0;
+		Grow(1);
+	}
+	// Returns NULL for code points the font does not have, or that did not fit.
+	const Glyph* Find(Uint32 c) {
+		auto it = entries.find(c);
+		if (it != entries.end()) {
+			if (it->second.cell >= 0) {
+				cells[it->second.cell].lastUsedFrame = frame;
+			}
+			return &it->second.glyph;
+		}
+		if (c == 0 || c > 0xFFFF || !TTF_GlyphIsProvided(font, (Uint16) c)) {
+			return NULL;
+		}
+		misses++;
+		Entry entry;
+		int minx, maxx, miny, maxy, advance;
+		TTF_GlyphMetrics(font, (Uint16) c, &minx, &maxx, &miny, &maxy, &advance);
+		if (maxx - std::max(0, minx) > cellSize - 2 * FontAtlas::PADDING) {
+			// RenderGlyph crops to the line box, which is never taller than a cell, so only
+			// the width can overflow it
+			std::cout << "Glyph " << c << " is wider than a glyph cache cell and is left out" << std::endl;
+			Glyph blank = { 0, 0, 0, 0, 0, 0, advance };
+			entry.glyph = blank;
+			entry.cell = -1;
+			return &entries.insert(std::make_pair(c, entry)).first->second.glyph;
+		}
+		int cell = FreeCell();
+		if (cell < 0) {
+			dropped++;
+			return NULL;
+		}
+		entry.cell = cell;
+		Rasterize(c, cell, entry.glyph);
+		cells[cell].codepoint = c;
+		cells[cell].lastUsedFrame = frame;
+		return &entries.insert(std::make_pair(c, entry)).first->second.glyph;
+	}
+	int Kerning(Uint32 first, Uint32 second) const {
+		return first > 0xFFFF || second > 0xFFFF ? 0 : TTF_GetFontKerningSizeGlyphs(font, (Uint16) first, (Uint16) second);
+	}
+	// Must be called once the text of the current frame has been drawn.
+	void EndFrame() {
+		frame++;
+	}
+	int GlyphCount() const {
+		return entries.size();
+	}
+	size_t Bytes() const {
+		return pixels.size();
+	}
+	size_t BudgetBytes() const {
+		return (size_t) maxRows * WIDTH * cellSize;
+	}
+	~GlyphCache() {
+		TTF_CloseFont(font);
+	}
+private:
+	struct Entry {
+		Glyph glyph;
+		int cell;
+	};
+	struct Cell {
+		Uint32 codepoint; // 0 while free
+		int lastUsedFrame;
+	};
+	std::map<Uint32, Entry> entries;
+	std::vector<Cell> cells;
+	int frame;
+	int Rows() const {
+		return texture->height / cellSize;
+	}
+	void Grow(int rows) {
+		pixels.resize(WIDTH * rows * cellSize, 0);
+		texture = std::shared_ptr<Texture>(new Texture(WIDTH, rows * cellSize, &pixels[0], GL_RED));
+		Cell free = { 0, -1 };
+		cells.resize(rows * columns, free);
+	}
+	int FreeCell() {
+		int lru = -1;
+		for (size_t i=0; i < cells.size(); i++) {
+			if (cells[i].codepoint == 0) {
+				return i;
+			}
+			if (cells[i].lastUsedFrame < frame && (lru < 0 || cells[i].lastUsedFrame < cells[lru].lastUsedFrame)) {
+				lru = i;
+			}
+		}
+		if (Rows() < maxRows) {
+			int first = cells.size();
+			Grow(std::min(Rows() * 2, maxRows));
+			return first;
+		}
+		if (lru >= 0) {
+			entries.erase(cells[lru].codepoint);
+			evictions++;
+			epoch++;
+		}
+		return lru;
+	}
+	// Renders the glyph into its cell, with the same metrics as in a baked atlas.
+	void Rasterize(Uint32 c, int cell, Glyph& g) {
+		const int padding = FontAtlas::PADDING;
+		const int cellX = cell % columns * cellSize, cellY = cell / columns * cellSize;
+		std::vector<GLubyte> coverage;
+		RenderGlyph(font, c, g, coverage); // Find made sure it fits
+		g.x = cellX + padding;
+		g.y = cellY + padding;
+		// the whole cell is written, to clear what the previous glyph left in it
+		std::vector<GLubyte> cellPixels(cellSize * cellSize, 0);
+		for (int row=0; row < g.height; row++) {
+			memcpy(&cellPixels[(row + padding) * cellSize + padding], &coverage[row * g.width], g.width);
+		}
+		for (int row=0; row < cellSize; row++) {
+			memcpy(&pixels[(cellY + row) * WIDTH + cellX], &cellPixels[row * cellSize], cellSize);
+		}
+		texture->Update(cellX, cellY, cellSize, cellSize, &cellPixels[0]);
+	}
+	GlyphCache(const GlyphCache&);
+};
+
+// What the asset loader prepares for a font: either its whole atlas, or the opened font
+// for a glyph cache to rasterize on demand.
+struct FontSource {
+	FontAtlas atlas;
+	TTF_Font* ttf;
+	int size;
 };
 
+// A font, as the glyph metrics needed to lay text out with it and the single channel
+// texture they refer to. Its glyphs come either from a whole atlas, uploaded once, or
+// from a glyph cache. Distance field fonts are always whole atlases, rasterized at
+// DISTANCE_FIELD_SIZE and scaled to whatever size the text is written at.
 struct Font {
-	std::vector<std::shared_ptr<Texture>> letters;
-	Font(const std::string& filename, int size) {
-		letters.reserve(128);
-		letters.resize(128);
-		TTF_Font* font = TTF_OpenFont(filename.c_str(), size);
-		SDL_Color text_color = { 255, 255, 255 };
-		for (char c=32; c<120; c++){
-			char str[2] = { ' ', 0 };
-			str[0] = c;
-			SDL_Surface* letter = TTF_RenderText_Solid(font, str, text_color);
-			letters[c] = std::shared_ptr<Texture>(new Texture(letter));			
-			SDL_FreeSurface(letter);
+	static const int DISTANCE_FIELD_SIZE = 32;
+	static const int DISTANCE_FIELD_SPREAD = 4;
+	std::shared_ptr<Texture> atlas;
+	FontAtlas metrics; // the glyphs and kerning of the atlas, whose pixels are in the texture
+	std::shared_ptr<GlyphCache> cache;
+	int size;
+	int spread;
+	Font(const FontSource& source, size_t glyphCacheBytes) {
+		if (source.ttf != NULL) {
+			cache = std::shared_ptr<GlyphCache>(new GlyphCache(source.ttf, glyphCacheBytes));
+			size = source.size;
+			spread = 0;
+			return;
 		}
+		const FontAtlas& fontAtlas = source.atlas;
+		metrics.glyphs = fontAtlas.glyphs;
+		metrics.kerning = fontAtlas.kerning;
+		size = fontAtlas.size;
+		spread = fontAtlas.spread;
+		atlas = std::shared_ptr<Texture>(new Texture(fontAtlas.width, fontAtlas.height, &fontAtlas.pixels[0], GL_RED));
 	}
+	// Returns NULL when the font has no glyph for c. The glyph stays valid until the
+	// epoch changes.
+	const Glyph* Find(Uint32 c) {
+		if (cache) {
+			return cache->Find(c);
+		}
+		return metrics.Contains(c) ? &metrics.glyphs[c] : NULL;
+	}
+	int Kerning(Uint32 first, Uint32 second) const {
+		if (cache) {
+			return cache->Kerning(first, second);
+		}
+		return metrics.Kerning(first, second);
+	}
+	int Epoch() const {
+		return cache ? cache->epoch : 0;
+	}
+	// Glyphs the cache had no room for so far.
+	int Dropped() const {
+		return cache ? cache->dropped : 0;
+	}
+	const Texture& Atlas() const {
+		return cache ? *cache->texture : *atlas;
+	}
+	void EndFrame() {
+		if (cache) {
+			cache->EndFrame();
+		}
+	}
+	bool DistanceField() const {
+		return spread > 0;
+	}
+	// Loads the atlas the bake tool made for this font and size, "arial-20.fontatlas" for
+	// arial.ttf at 20 points or "arial-sdf.fontatlas" for its distance field. Without one,
+	// distance field atlases are rasterized whole, and other fonts are just opened for
+	// their glyph cache.
+	static FontSource Load(const std::string& filename, int size, bool distanceField) {
+		std::stringstream baked;
+		baked << filename.substr(0, filename.rfind('.')) << "-";
+		if (distanceField) {
+			baked << "sdf.fontatlas";
+			size = DISTANCE_FIELD_SIZE;
+		} else {
+			baked << size << ".fontatlas";
+		}
+		FontSource source;
+		source.ttf = NULL;
+		source.size = size;
+		SDL_RWops* rw = archive.TryOpen(baked.str());
+		if (rw != NULL && LoadFontAtlas(source.atlas, rw) && source.atlas.DistanceField() == distanceField) {
+			return source;
+		}
+		TTF_Font* font = TTF_OpenFontRW(archive.Open(filename), 1, size);
+		if (font == NULL) {
+			std::cout << "Failed to open font " << filename << ": " << TTF_GetError() << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		if (!distanceField) {
+			source.ttf = font;
+			return source;
+		}
+		source.atlas = RasterizeFontAtlas(font, size, AsciiCharset(), DISTANCE_FIELD_SPREAD);
+		TTF_CloseFont(font);
+		return source;
+	}
+};
+
+// Laid out text kept in static buffers between frames.
+struct RetainedText {
+	Geometry geometry;
+	Color color;
+	int lastUsedFrame;
+	std::vector<Uint32> codepoints;
+	int fontEpoch; // of the layout, -1 to lay it out again
+	RetainedText() : geometry(true) {}
 };
 
+// Queues the glyph quads of every Write call and draws them all at once in Flush,
+// so a frame of text costs a single write to the stream buffer and a single draw call.
+// Text that does not change from frame to frame should go through WriteRetained instead:
+// its layout is cached per (string, origin), since the writer is bound to a single font,
+// and is only uploaded once. Cached runs not drawn for EVICTION_FRAMES frames are released.
+// Text is drawn in the color last passed to SetColor; queued text only needs another draw
+// call where the color changes. It is drawn at the size last passed to SetSize, which
+// starts as the size of the font; only distance field fonts stay sharp when scaled.
+// Strings are UTF-8; characters the font does not have are skipped. Retained runs keep
+// their glyphs in the font's glyph cache, and are laid out again when it evicted some,
+// or the next frame when it had no room for some of theirs.
 struct TextWriter {
-	const Font& font;
-    std::shared_ptr<TextureProgram> textureProgram;
-	TextWriter(const Font& font_) : font(font_) {
-		textureProgram = TextureProgram::Create();
+	static const int EVICTION_FRAMES = 120;
+	typedef std::tuple<std::string, int, int, int> RetainedKey;
+	Font& font;
+	StreamBuffer& stream;
+    std::shared_ptr<TextProgram> textProgram;
+	Geometry batch;
+	std::vector<float> vertices;
+	std::vector<std::pair<size_t, Color>> colorRuns; // first float of each run in vertices
+	Color color;
+	int size;
+	std::map<RetainedKey, std::shared_ptr<RetainedText>> retained;
+	std::vector<std::shared_ptr<RetainedText>> retainedQueue;
+	int frame;
+	TextWriter(Font& font_, StreamBuffer& stream_) : font(font_), stream(stream_), batch(true) {
+		textProgram = TextProgram::Create(font.DistanceField());
+		size = font.size;
+		frame = 0;
 	}
-	void Write(const std::string& text, int x, int y, const Win& win) {
+	void SetColor(const Color& color_) {
+		color = color_;
+	}
+	void SetSize(int points) {
+		size = points;
+	}
+	void Write(const std::string& text, int x, int y) {
+		if (colorRuns.empty() || colorRuns.back().second != color) {
+			colorRuns.push_back(std::make_pair(vertices.size(), color));
+		}
+		Layout(text, x, y, vertices);
+	}
+	void WriteRetained(const std::string& text, int x, int y) {
+		RetainedKey key(text, x, y, size);
+		auto it = retained.find(key);
+		if (it == retained.end()) {
+			std::shared_ptr<RetainedText> run(new RetainedText);
+			for (size_t i=0; i < text.size(); ) {
+				run->codepoints.push_back(DecodeUTF8(text, i));
+			}
+			run->fontEpoch = -1;
+			it = retained.insert(std::make_pair(key, run)).first;
+		} else {
+			// keeps the glyphs of the run from being evicted while it is in use
+			for (size_t i=0; i < it->second->codepoints.size(); i++) {
+				font.Find(it->second->codepoints[i]);
+			}
+		}
+		if (it->second->fontEpoch != font.Epoch()) {
+			std::vector<float> runVertices;
+			const int dropped = font.Dropped();
+			Layout(text, x, y, runVertices);
+			it->second->fontEpoch = font.Dropped() == dropped ? font.Epoch() : -1;
+			it->second->geometry.indexCount = 0;
+			if (!runVertices.empty()) {
+				it->second->geometry.SetVertices(&runVertices[0], runVertices.size() * sizeof(float));
+				it->second->geometry.SetQuadIndices(it->second->geometry.vertexCount / 4);
+			}
+		}
+		it->second->color = color;
+		it->second->lastUsedFrame = frame;
+		retainedQueue.push_back(it->second);
+	}
+	void Flush(const Win& win) {
         int width, height;
         SDL_GetWindowSize(win.w, &width, &height);
     	Matrix44<float> mat = Ortho<float>(width, 0, height, 0, 1.0f, -1.0f);
-		for (const char& c : text) {
-			const Texture& t = *font.letters[c];
-			Geometry myTextBox;
-			float positions[] = {
-				x, y, 0.0f,
-				x+t.width, y, 0.0f,
-				x+t.width, y+t.height, 0.0f,
-				x, y+t.height, 0.0f
-			};
-			float texcoords[] = {
-				0.0f, 0.0f,
-				1.0f, 0.0f,
-				1.0f, 1.0f,
-				0.0f, 1.0f
-			};
-			myTextBox.SetVertexPositions(positions, sizeof(positions));
-			myTextBox.SetVertexTexCoords(texcoords, sizeof(texcoords));
-			textureProgram->Render(myTextBox, t, mat);
-			x += t.width;
+		for (auto it = retainedQueue.begin(); it != retainedQueue.end(); it++) {
+			if ((*it)->geometry.indexCount > 0) {
+				textProgram->Render((*it)->geometry, font.Atlas(), (*it)->color, mat);
+			}
+		}
+		retainedQueue.clear();
+		for (size_t i=0; i < colorRuns.size(); i++) {
+			size_t begin = colorRuns[i].first;
+			size_t end = i + 1 < colorRuns.size() ? colorRuns[i+1].first : vertices.size();
+			if (end > begin) {
+				batch.StreamVertices(stream, &vertices[begin], (end - begin) * sizeof(float));
+				batch.SetQuadIndices(batch.vertexCount / 4);
+				textProgram->Render(batch, font.Atlas(), colorRuns[i].second, mat);
+			}
+		}
+		vertices.clear();
+		colorRuns.clear();
+		for (auto it = retained.begin(); it != retained.end(); ) {
+			if (frame - it->second->lastUsedFrame > EVICTION_FRAMES) {
+				it = retained.erase(it);
+			} else {
+				it++;
+			}
+		}
+		font.EndFrame();
+		frame++;
+	}
+private:
+	void Layout(const std::string& text, int x, int y, std::vector<float>& runVertices) {
+		// distance field quads also cover the spread around the glyph box; texture
+		// coordinates are in texels, the shaders normalize them with the current atlas size
+		const float scale = (float) size / font.size;
+		const float spread = font.spread * scale;
+		float left = (float) x;
+		Uint32 previous = 0;
+		for (size_t i=0; i < text.size(); ) {
+			Uint32 c = DecodeUTF8(text, i);
+			const Glyph* g = font.Find(c);
+			if (g == NULL) {
+				continue;
+			}
+			left += font.Kerning(previous, c) * scale;
+			previous = c;
+			if (g->width > 0 && g->height > 0) {
+				const float x0 = left + g->offsetX * scale - spread, x1 = x0 + g->width * scale + 2 * spread;
+				const float y0 = y + g->offsetY * scale - spread, y1 = y0 + g->height * scale + 2 * spread;
+				const float u0 = (float) (g->x - font.spread), u1 = (float) (g->x + g->width + font.spread);
+				const float v0 = (float) (g->y - font.spread), v1 = (float) (g->y + g->height + font.spread);
+				float quad[] = {
+					x0, y0, 0.0f, u0, v0,
+					x1, y0, 0.0f, u1, v0,
+					x1, y1, 0.0f, u1, v1,
+					x0, y1, 0.0f, u0, v1
+				};
+				runVertices.insert(runVertices.end(), quad, quad + 20);
+			}
+			left += g->advance * scale;
 		}
 	}
 };
 
+// The sprite stress scene, "--sprites <count>": small sprites bouncing around the window,
+// spread over a few textures and depths, and all submitted again every frame.
+struct SpriteStress {
+	static const int TEXTURES = 4;
+	static const int DEPTHS = 4;
+	static const int TEXTURE_SIZE = 16;
+	struct Mover {
+		float x, y, vx, vy;
+		float size;
+		int texture;
+		float depth;
+		Color color;
+	};
+	std::vector<std::shared_ptr<Texture>> textures;
+	std::vector<Mover> movers;
+	int width;
+	int height;
+	SpriteStress(int count, int width_, int height_) {
+		width = width_;
+		height = height_;
+		for (int i=0; i < TEXTURES; i++) {
+			textures.push_back(CreateTexture(i));
+		}
+		srand(1); // the same scene on every run
+		for (int i=0; i < count; i++) {
+			Mover m;
+			m.size = 4.0f + rand() % 13;
+			m.x = Random(0.0f, width - m.size);
+			m.y = Random(0.0f, height - m.size);
+			m.vx = Random(-100.0f, 100.0f);
+			m.vy = Random(-100.0f, 100.0f);
+			m.texture = rand() % TEXTURES;
+			m.depth = (float) (rand() % DEPTHS);
+			m.color = Color(Random(0.3f, 1.0f), Random(0.3f, 1.0f), Random(0.3f, 1.0f), 0.8f);
+			movers.push_back(m);
+		}
+	}
+	// Moves the sprites by a fixed step, so that benchmarks do the same work on any machine.
+	void Update(SpriteBatch& batch) {
+		const float step = 1.0f / 60;
+		for (size_t i=0; i < movers.size(); i++) {
+			Mover& m = movers[i];
+			m.x += m.vx * step;
+			m.y += m.vy * step;
+			if (m.x < 0.0f || m.x > width - m.size) {
+				m.vx = -m.vx;
+			}
+			if (m.y < 0.0f || m.y > height - m.size) {
+				m.vy = -m.vy;
+			}
+			batch.Submit(*textures[m.texture], m.x, m.y, m.size, m.size, 0.0f, 0.0f, 1.0f, 1.0f, m.color, m.depth);
+		}
+	}
+private:
+	static float Random(float min, float max) {
+		return min + (max - min) * rand() / RAND_MAX;
+	}
+	// white shapes, tinted by the sprite color: a disc, a ring, a diamond and a square outline
+	static std::shared_ptr<Texture> CreateTexture(int shape) {
+		std::vector<GLubyte> data(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+		const float c = (TEXTURE_SIZE - 1) / 2.0f;
+		for (int y=0; y < TEXTURE_SIZE; y++) {
+			for (int x=0; x < TEXTURE_SIZE; x++) {
+				const float dx = x - c, dy = y - c;
+				const float r = std::sqrt(dx * dx + dy * dy);
+				bool inside = false;
+				switch (shape) {
+				case 0: inside = r <= c; break;
+				case 1: inside = r <= c && r >= c - 3.0f; break;
+				case 2: inside = std::fabs(dx) + std::fabs(dy) <= c; break;
+				default: inside = std::max(std::fabs(dx), std::fabs(dy)) >= c - 2.0f; break;
+				}
+				GLubyte* p = &data[(y * TEXTURE_SIZE + x) * 4];
+				p[0] = p[1] = p[2] = 255;
+				p[3] = inside ? 255 : 0;
+			}
+		}
+		std::shared_ptr<Texture> texture(new Texture(TEXTURE_SIZE, TEXTURE_SIZE, &data[0]));
+		texture->GenerateMipmaps(); // the sprites are 4 to 16 pixels wide
+		return texture;
+	}
+};
+
 int main(int argc, char **argv)
 {
 	const int width = 1024;
 	const int height = 768;
 
+	int spriteCount = 0; // "--sprites <count>" runs the sprite stress scene, benchmarked as "sprites"
+	for (int i=1; i < argc - 1; i++) {
+		if (std::string(argv[i]) == "--sprites") {
+			spriteCount = atoi(argv[i+1]);
+		}
+	}
+	Bench bench(spriteCount > 0 ? "sprites" : "fps", argc, argv);
+	FramePacer pacer(argc, argv); // "--pacing uncapped" against "--pacing vsync" gives the cost of the frame
+	bool serialLoad = false; // "--serial-load" gives the startup time without the loader threads
+	bool distanceField = false; // "--sdf" writes with a distance field font
+	std::string programCacheDir;
+	size_t glyphCacheBytes = 256 * 1024; // "--glyph-budget <KB>" bounds the glyph cache texture
+	for (int i=1; i < argc; i++) {
+		if (std::string(argv[i]) == "--serial-load") {
+			serialLoad = true;
+		}
+		if (std::string(argv[i]) == "--sdf") {
+			distanceField = true;
+		}
+		if (std::string(argv[i]) == "--program-cache" && i + 1 < argc) {
+			programCacheDir = argv[i+1];
+		}
+		if (std::string(argv[i]) == "--glyph-budget" && i + 1 < argc) {
+			glyphCacheBytes = atoi(argv[i+1]) * 1024;
+		}
+	}
+	archive.Map("../assets.pak"); // loose files are read instead when there is no archive
 	App app;
+
+	// read and rasterize the assets while the window and the GL context are being created
+	AssetLoader loader(serialLoad ? 0 : AssetLoader::DefaultWorkers());
+	double fontLoadMs = 0.0;
+	std::shared_future<FontSource> fontSource = loader.Load([distanceField, &fontLoadMs]() {
+		Uint64 start = SDL_GetPerformanceCounter();
+		FontSource fontSource = Font::Load("arial.ttf", 20, distanceField);
+		fontLoadMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		return fontSource;
+	});
+	const char* shaderFiles[] = { "monochrome.vert", "monochrome.frag", "texture.vert", "text.frag", "sdf.frag", "sprite.vert", "sprite.frag" };
+	for (const char* filename : shaderFiles) {
+		std::string name = filename;
+		preloadedTextFiles[name] = loader.Load([name]() { return archive.ReadText(name); });
+	}
+
 	Win win("FPS Test", width, height);
-	Font font("arial.ttf", 20);
-	win.Show();
+	pacer.Apply();
+	if (!programCacheDir.empty()) {
+		programCache.Open(programCacheDir);
+	}
+	Font font(fontSource.get(), glyphCacheBytes);
+	if (!bench.Enabled()) {
+		win.Show();
+	}
 
 	Matrix44<float> mat = Ortho<float>(width, 0, height, 0, 1.0f, -1.0f);
     std::shared_ptr<MonochromeProgram> monochromeProgram = MonochromeProgram::Create();
-	TextWriter textWriter(font);
+	StreamBuffer streamBuffer(1024 * 1024);
+	TextWriter textWriter(font, streamBuffer);
+	std::shared_ptr<SpriteBatch> spriteBatch;
+	std::shared_ptr<SpriteStress> spriteStress;
+	if (spriteCount > 0) {
+		spriteBatch = std::shared_ptr<SpriteBatch>(new SpriteBatch(streamBuffer));
+		spriteStress = std::shared_ptr<SpriteStress>(new SpriteStress(spriteCount, width, height));
+	}
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	std::stringstream fontStr;
+	fontStr.precision(1);
+	if (font.cache) {
+		fontStr << std::fixed << "glyph cache font: " << font.cache->BudgetBytes() / 1024 << " KB budget, opened in " << fontLoadMs << " ms";
+	} else {
+		fontStr << std::fixed << (font.DistanceField() ? "distance field" : "bitmap") << " font atlas: " << font.atlas->width << "x" << font.atlas->height
+			<< ", " << font.atlas->width * font.atlas->height << " bytes, loaded in " << fontLoadMs << " ms";
+	}
+	if (!bench.Enabled()) {
+		std::cout << fontStr.str() << std::endl;
+	}
+	std::stringstream programCacheStr;
+	programCacheStr.precision(1);
+	programCacheStr << std::fixed << "program cache: " << programCache.hits << " hits, "
+		<< programCache.misses << " misses, " << programCache.msSaved << " ms saved";
+	if (programCache.Enabled() && !bench.Enabled()) {
+		std::cout << programCacheStr.str() << std::endl;
+	}
 
     Geometry myGeometry;
     float linesVertices[] = {
@@ -309,18 +1383,24 @@ int main(int argc, char **argv)
             width/2, 0.0f, 0.0f,
             width/2, height, 0.0f,
 	};
-	myGeometry.SetVertexPositions(linesVertices, sizeof(linesVertices));
+	myGeometry.SetVertices(linesVertices, sizeof(linesVertices));
 
     SDL_Event event;
     bool done = false;
-    int frameTimeIndex = 0;
-    std::vector<int> frameTimes;
-    frameTimes.resize(10);
-    frameTimes.reserve(10);
-    int t0 = SDL_GetTicks();
+    FrameStats frameStats;
+	for (int i=1; i < argc - 1; i++) {
+		if (std::string(argv[i]) == "--csv") {
+			frameStats.StartCsv(argv[i+1]);
+		}
+	}
+	GpuTimer gpuTimer;
+	const int clearPass = gpuTimer.AddPass("clear");
+	const int crosshairPass = gpuTimer.AddPass("crosshair");
+	const int spritesPass = spriteStress ? gpuTimer.AddPass("sprites") : -1;
+	const int textPass = gpuTimer.AddPass("text");
+    FrameCounters lastFrameCounters;
     while (!done) {
-        int t1 = SDL_GetTicks();
-        frameTimes[frameTimeIndex % frameTimes.size()] = t1-t0;
+		frameStats.Frame();
 		while (SDL_PollEvent(&event)) {
 			switch (event.type) {
 			case SDL_QUIT: 
@@ -328,18 +1408,88 @@ int main(int argc, char **argv)
 				break;
             }
         }
-		glClear(GL_COLOR_BUFFER_BIT);
-		monochromeProgram->Render(myGeometry, mat);
+		{
+			GpuTimerScope scope(gpuTimer, clearPass);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+		{
+			GpuTimerScope scope(gpuTimer, crosshairPass);
+			monochromeProgram->Render(myGeometry, mat);
+		}
+		if (spriteStress) {
+			GpuTimerScope scope(gpuTimer, spritesPass);
+			spriteStress->Update(*spriteBatch);
+			spriteBatch->Flush(mat);
+		}
+		textWriter.SetColor(Color(1.0f, 1.0f, 1.0f));
+		textWriter.SetSize(font.size);
         std::stringstream fpsStr;
-        int sum = std::accumulate(frameTimes.begin(),frameTimes.end(),0);
-        int avg = sum / frameTimes.size();
-        int fps = 1000.0 / avg;
-        fpsStr << fps << " FPS";
-		textWriter.Write(fpsStr.str(), 10, 10, win);
-        textWriter.Write("Hello again, SDL!", 10, height-30, win);
+        int fps = frameStats.AvgMs() > 0 ? (int) (1000.0 / frameStats.AvgMs()) : 0;
+        fpsStr << fps << " FPS, " << frameStats.Hitches() << " hitches";
+		textWriter.Write(fpsStr.str(), 10, 10);
+		std::stringstream frameTimeStr;
+		frameTimeStr.precision(2);
+		frameTimeStr << std::fixed << "min " << frameStats.MinMs() << " avg " << frameStats.AvgMs()
+			<< " p50 " << frameStats.PercentileMs(50) << " p95 " << frameStats.PercentileMs(95)
+			<< " p99 " << frameStats.PercentileMs(99) << " max " << frameStats.MaxMs() << " ms";
+		textWriter.Write(frameTimeStr.str(), 10, 35);
+		std::stringstream countersStr;
+		countersStr << lastFrameCounters.drawCalls << " draws, " << lastFrameCounters.bufferAllocations << " buffer allocs, "
+			<< lastFrameCounters.bytesStreamed << " bytes streamed, " << lastFrameCounters.streamStalls << " stalls";
+		textWriter.Write(countersStr.str(), 10, 60);
+		std::stringstream stateStr;
+		stateStr << lastFrameCounters.stateCallsIssued << " state calls, " << lastFrameCounters.stateCallsElided << " elided";
+		textWriter.Write(stateStr.str(), 10, 85);
+		std::stringstream passesStr;
+		passesStr.precision(3);
+		passesStr << std::fixed;
+		for (size_t i=0; i < gpuTimer.passes.size(); i++) {
+			const GpuTimer::Pass& pass = gpuTimer.passes[i];
+			passesStr << pass.name << " cpu " << pass.cpuMs << " gpu " << pass.gpuMs << " ms  ";
+		}
+		textWriter.Write(passesStr.str(), 10, 110);
+		if (programCache.Enabled()) {
+			textWriter.WriteRetained(programCacheStr.str(), 10, 135);
+		}
+		textWriter.WriteRetained(fontStr.str(), 10, 160);
+		if (font.cache) {
+			std::stringstream glyphCacheStr;
+			glyphCacheStr << "glyph cache: " << font.cache->GlyphCount() << " glyphs, " << font.cache->Bytes() / 1024 << "/"
+				<< font.cache->BudgetBytes() / 1024 << " KB, " << font.cache->misses << " misses, "
+				<< font.cache->evictions << " evictions, " << font.cache->dropped << " dropped";
+			textWriter.Write(glyphCacheStr.str(), 10, 185);
+		}
+		textWriter.Write(pacer.Summary(), 10, 235);
+		if (spriteStress) {
+			std::stringstream spritesStr;
+			spritesStr.precision(2);
+			spritesStr << std::fixed << spriteCount << " sprites in " << spriteBatch->lastDrawCalls << " draws, "
+				<< gpuTimer.passes[spritesPass].cpuMs << " ms to submit, "
+				<< (frameStats.AvgMs() > 0 ? spriteCount / frameStats.AvgMs() / 1000.0 : 0.0) << " M sprites/s";
+			textWriter.Write(spritesStr.str(), 10, 260);
+		}
+		// "Hello" in French, Greek and Russian
+		textWriter.WriteRetained("Bonjour \xc3\xa0 tous, \xce\x93\xce\xb5\xce\xb9\xce\xb1 \xcf\x83\xce\xb1\xcf\x82, "
+			"\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", 10, 210);
+		textWriter.SetColor(Color(0.4f, 0.8f, 1.0f, 0.8f));
+		if (font.DistanceField()) {
+			textWriter.SetSize(48); // bitmap glyphs would blur when scaled up
+		}
+        textWriter.WriteRetained("Hello again, SDL!", 10, height-60);
+		{
+			GpuTimerScope scope(gpuTimer, textPass);
+			textWriter.Flush(win);
+		}
+		gpuTimer.EndFrame();
+		streamBuffer.EndFrame();
 		SDL_GL_SwapWindow(win.w);
-        t0 = t1;
-        frameTimeIndex++;
+		pacer.Frame();
+		lastFrameCounters = frameCounters;
+		bench.drawCalls += frameCounters.drawCalls;
+		frameCounters.Reset();
+		if (!bench.Frame()) {
+			done = true;
+		}
     }
 
     return 0;
@@ -0,0 +1,17 @@
+#version 330 core
+
+uniform sampler2D tex;
+uniform vec4 color;
+
+in vec2 vTexCoord;
+
+out vec4 fColor;
+
+void main(void)
+{
+	// the texture holds the distance to the glyph edge, 0.5 being on the edge;
+	// fwidth keeps the antialiased ramp about a pixel wide at any scale
+	float distance = texture(tex, vTexCoord / vec2(textureSize(tex, 0))).r;
+	float ramp = fwidth(distance) * 0.5;
+	fColor = vec4(color.rgb, color.a * smoothstep(0.5 - ramp, 0.5 + ramp, distance));
+}
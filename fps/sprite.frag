@@ -0,0 +1,13 @@
+#version 330 core
+
+uniform sampler2D tex;
+
+in vec2 vTexCoord;
+in vec4 vColor;
+
+out vec4 fColor;
+
+void main(void)
+{
+	fColor = texture(tex, vTexCoord) * vColor;
+}
@@ -0,0 +1,19 @@
+#version 330 core
+
+uniform mat4 mvpMatrix;
+
+in vec4 rect; // x, y, width, height
+in vec4 uvRect; // u0, v0, u1, v1
+in vec4 color;
+
+out vec2 vTexCoord;
+out vec4 vColor;
+
+void main(void)
+{
+	// one instance per sprite, drawn as a four vertex triangle strip
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	gl_Position = mvpMatrix * vec4(rect.xy + corner * rect.zw, 0.0f, 1.0f);
+	vTexCoord = mix(uvRect.xy, uvRect.zw, corner);
+	vColor = color;
+}
@@ -0,0 +1,15 @@
+#version 330 core
+
+uniform sampler2D tex;
+uniform vec4 color;
+
+in vec2 vTexCoord;
+
+out vec4 fColor;
+
+void main(void)
+{
+	// the glyph texture only holds coverage, the color comes from the writer; texture
+	// coordinates are in texels, so that the glyph cache can grow the texture under them
+	fColor = vec4(color.rgb, color.a * texture(tex, vTexCoord / vec2(textureSize(tex, 0))).r);
+}
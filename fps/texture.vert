@@ -1,7 +1,6 @@
 #version 330 core
 
 uniform mat4 mvpMatrix;
-uniform sampler2D texture;
 
 in vec3 pos;
 in vec2 texCoord;
@@ -1,8 +1,108 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <string.h>
 #include <SDL.h>
 #include <GL/glew.h>
+#include "bench.h"
+#include "framepacer.h"
+#include "gputimer.h"
+#include "matrix.h"
 
+// An offscreen color buffer the scene is rendered into at a fraction of the window
+// resolution, then stretched over the window with a single filtered blit. The fraction
+// follows the GPU time of the scene, so that large displays keep their frame rate at the
+// cost of sharpness. The scene goes into the lower left corner of a buffer sized for
+// maxScale, so a new scale only moves the viewport; the buffer is only reallocated when
+// the window size changes.
+struct ScaledTarget {
+	GLuint framebufferId;
+	GLuint colorId;
+	int windowWidth;
+	int windowHeight;
+	float scale;
+	float minScale;
+	float maxScale;
+	int cooldown; // frames until the effect of the last change shows in the timings
+	ScaledTarget(int width, int height, float minScale_, float maxScale_) {
+		minScale = minScale_;
+		maxScale = maxScale_;
+		scale = maxScale;
+		cooldown = 0;
+		glGenFramebuffers(1, &framebufferId);
+		glGenRenderbuffers(1, &colorId);
+		Resize(width, height);
+	}
+	void Resize(int width, int height) {
+		windowWidth = width;
+		windowHeight = height;
+		glBindRenderbuffer(GL_RENDERBUFFER, colorId);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Scaled(width, maxScale), Scaled(height, maxScale));
+		glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorId);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			std::cout << "Incomplete render target framebuffer" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	int Width() const {
+		return Scaled(windowWidth, scale);
+	}
+	int Height() const {
+		return Scaled(windowHeight, scale);
+	}
+	// Binds the target and clears the part of it the scene is rendered to.
+	void Begin() {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebufferId);
+		glViewport(0, 0, Width(), Height());
+		glScissor(0, 0, Width(), Height());
+		glEnable(GL_SCISSOR_TEST);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
+	}
+	// Upscales the scene to the default framebuffer.
+	void End() {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebufferId);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, Width(), Height(), 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+	// Picks the scale of the next frames from the GPU time of the last measured one.
+	// The cost of the scene goes with its pixel count, the square of the scale; it is
+	// cut at once when over budget, and raised in small steps when well under it.
+	void Adjust(double sceneMs, double budgetMs) {
+		if (sceneMs <= 0.0 || --cooldown > 0) {
+			return;
+		}
+		float next = scale;
+		if (sceneMs > budgetMs) {
+			next = scale * (float) std::sqrt(budgetMs / sceneMs);
+		} else if (sceneMs < budgetMs * 0.7) {
+			next = scale * 1.05f;
+		}
+		next = std::min(maxScale, std::max(minScale, next));
+		if (next != scale) {
+			scale = next;
+			cooldown = GpuTimer::LATENCY;
+		}
+	}
+	~ScaledTarget() {
+		glDeleteFramebuffers(1, &framebufferId);
+		glDeleteRenderbuffers(1, &colorId);
+	}
+private:
+	static int Scaled(int size, float s) {
+		return std::max(1, (int) (size * s + 0.5f));
+	}
+	ScaledTarget(const ScaledTarget&);
+};
+
+// "--target-fps <hz>" sets the frame rate the render scale is adapted to, 60 by default,
+// within "--min-scale" and "--max-scale", 0.5 and 1 by default.
 int main(int argc, char **argv)
 {
 	const int width = 800;
@@ -12,14 +112,34 @@ int main(int argc, char **argv)
 	// Up to 16 attributes per vertex is allowed so any value between 0 and 15 will do.
 	const int POSITION_ATTRIBUTE_INDEX = 0;
 
-	SDL_Init(SDL_INIT_EVERYTHING);
+	Bench bench("fullscr", argc, argv);
+	FramePacer pacer(argc, argv);
+	double targetFps = 60.0;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	for (int i=1; i < argc - 1; i++) {
+		if (std::string(argv[i]) == "--target-fps") {
+			targetFps = std::max(1.0, atof(argv[i+1]));
+		}
+		if (std::string(argv[i]) == "--min-scale") {
+			minScale = (float) atof(argv[i+1]);
+		}
+		if (std::string(argv[i]) == "--max-scale") {
+			maxScale = (float) atof(argv[i+1]);
+		}
+	}
+	minScale = std::max(0.1f, std::min(minScale, maxScale));
+	RequireSDL(SDL_Init(SDL_INIT_EVERYTHING) == 0, "SDL_Init");
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-    SDL_Window* win = SDL_CreateWindow("GLEW Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+    SDL_Window* win = SDL_CreateWindow("GLEW Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, bench.WindowFlags(SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE));
+	RequireSDL(win != NULL, "SDL_CreateWindow");
 	SDL_GLContext ctx = SDL_GL_CreateContext(win);
+	RequireSDL(ctx != NULL, "SDL_GL_CreateContext");
 	glewInit(); // must be called AFTER the OpenGL context has been created
+	pacer.Apply();
 
 	glViewport(0, 0, width, height);
 
@@ -95,31 +215,22 @@ int main(int argc, char **argv)
     glBufferData(GL_ARRAY_BUFFER, sizeof(linesVertices), linesVertices, GL_STATIC_DRAW);
 
 	//
-	// defines the orthographic projection matrix
+	// defines the orthographic projection matrix, which follows the aspect ratio of the window
 	//
-	float m[16];
 	const float left = -1.5f;
 	const float right = 1.5f;
-	const float bottom = -1.5f / aspectRatio;
-	const float top = 1.5f / aspectRatio;
 	const float nearPlane = 1.0f;
 	const float farPlane = -1.0f;
-	m[0] = 2 / (right - left);
-    m[1] = 0.0f;
-    m[2] = 0.0f;
-    m[3] = 0.0f;
-    m[4] = 0.0f;
-    m[5] = 2 / (top - bottom);
-    m[6] = 0.0f;
-    m[7] = 0.0f;
-    m[8] = 0.0f;
-    m[9] = 0.0f;
-    m[10] = 2 / (farPlane - nearPlane);
-    m[11] = 0.0f;
-    m[12] = -(right + left) / (right - left);
-    m[13] = -(top + bottom) / (top - bottom);
-    m[14] = -(farPlane + nearPlane) / (farPlane - nearPlane);
-    m[15] = 1.0f;
+	Matrix44<float> projection = Ortho(right, left, 1.5f / aspectRatio, -1.5f / aspectRatio, nearPlane, farPlane);
+
+	//
+	// create the offscreen render target
+	//
+	ScaledTarget target(width, height, minScale, maxScale);
+	GpuTimer gpuTimer;
+	const int scenePass = gpuTimer.AddPass("scene");
+	// leaves some of the frame to the blit and the present
+	const double sceneBudgetMs = 1000.0 / targetFps * 0.8;
 
 	//
 	// SDL main loop
@@ -140,28 +251,32 @@ int main(int argc, char **argv)
 					fullscreen = !fullscreen;
 					if (fullscreen) {
 						SDL_SetWindowFullscreen(win, SDL_WINDOW_FULLSCREEN_DESKTOP);
-						int w, h;
-						SDL_GetWindowSize(win, &w, &h);
-						glViewport(0, 0, w, h);
 					} else {
 						SDL_SetWindowFullscreen(win, 0);
 						SDL_SetWindowSize(win, width, height);
-						glViewport(0, 0, width, height);
 					}
 				}
 				break;
-            }
+			}
+			// sent for fullscreen switches as well as for resizes
+			if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+				const int w = event.window.data1, h = event.window.data2;
+				target.Resize(w, h);
+				const float aspect = 1.0f * w / std::max(1, h);
+				projection = Ortho(right, left, 1.5f / aspect, -1.5f / aspect, nearPlane, farPlane);
+			}
         }
 
 		//
 		// rendering
 		//
 
-		glClear(GL_COLOR_BUFFER_BIT);
+		gpuTimer.Begin(scenePass);
+		target.Begin();
 		glUseProgram(programId);
 
 		GLuint matrixUniform = glGetUniformLocation(programId, "mvpMatrix");
-		glUniformMatrix4fv(matrixUniform, 1, false, m);
+		glUniformMatrix4fv(matrixUniform, 1, false, projection.m);
 
 		// we need the location of the uniform in order to set its value
 		GLuint color = glGetUniformLocation(programId, "color");
@@ -172,9 +287,24 @@ int main(int argc, char **argv)
 		glBindBuffer(GL_ARRAY_BUFFER, linesId);
 		glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
 		glDrawArrays(GL_LINES, 0, 16);
+		bench.drawCalls++;
 		glDisableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
+		gpuTimer.End(scenePass);
+		target.End();
+		gpuTimer.EndFrame();
+		target.Adjust(gpuTimer.passes[scenePass].gpuMs, sceneBudgetMs);
 
 		SDL_GL_SwapWindow(win);
+		if (pacer.Frame()) {
+			std::stringstream title;
+			title.precision(2);
+			title << std::fixed << "GLEW Test - " << pacer.Summary() << ", render scale " << target.scale
+				<< " (" << target.Width() << "x" << target.Height() << ")";
+			SDL_SetWindowTitle(win, title.str().c_str());
+		}
+		if (!bench.Frame()) {
+			done = true;
+		}
     }
 
 	SDL_GL_DeleteContext(ctx);
@@ -1,6 +1,9 @@
 #include <string.h>
 #include <SDL.h>
 #include <GL/glew.h>
+#include "bench.h"
+#include "framepacer.h"
+#include "matrix.h"
 
 int main(int argc, char **argv)
 {
@@ -11,14 +14,19 @@ int main(int argc, char **argv)
 	// Up to 16 attributes per vertex is allowed so any value between 0 and 15 will do.
 	const int POSITION_ATTRIBUTE_INDEX = 0;
 
-	SDL_Init(SDL_INIT_EVERYTHING);
+	Bench bench("glew", argc, argv);
+	FramePacer pacer(argc, argv);
+	RequireSDL(SDL_Init(SDL_INIT_EVERYTHING) == 0, "SDL_Init");
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-    SDL_Window* win = SDL_CreateWindow("GLEW Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+    SDL_Window* win = SDL_CreateWindow("GLEW Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, bench.WindowFlags(SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN));
+	RequireSDL(win != NULL, "SDL_CreateWindow");
 	SDL_GLContext ctx = SDL_GL_CreateContext(win);
+	RequireSDL(ctx != NULL, "SDL_GL_CreateContext");
 	glewInit(); // must be called AFTER the OpenGL context has been created
+	pacer.Apply();
 
 	glViewport(0, 0, width, height);
 
@@ -96,29 +104,13 @@ int main(int argc, char **argv)
 	//
 	// defines the orthographic projection matrix
 	//
-	float m[16];
 	const float left = -1.5f;
 	const float right = 1.5f;
 	const float bottom = -1.5f / aspectRatio;
 	const float top = 1.5f / aspectRatio;
 	const float nearPlane = 1.0f;
 	const float farPlane = -1.0f;
-	m[0] = 2 / (right - left);
-    m[1] = 0.0f;
-    m[2] = 0.0f;
-    m[3] = 0.0f;
-    m[4] = 0.0f;
-    m[5] = 2 / (top - bottom);
-    m[6] = 0.0f;
-    m[7] = 0.0f;
-    m[8] = 0.0f;
-    m[9] = 0.0f;
-    m[10] = 2 / (farPlane - nearPlane);
-    m[11] = 0.0f;
-    m[12] = -(right + left) / (right - left);
-    m[13] = -(top + bottom) / (top - bottom);
-    m[14] = -(farPlane + nearPlane) / (farPlane - nearPlane);
-    m[15] = 1.0f;
+	const Matrix44<float> projection = Ortho(right, left, top, bottom, nearPlane, farPlane);
 
 	//
 	// SDL main loop
@@ -142,7 +134,7 @@ int main(int argc, char **argv)
 		glUseProgram(programId);
 
 		GLuint matrixUniform = glGetUniformLocation(programId, "mvpMatrix");
-		glUniformMatrix4fv(matrixUniform, 1, false, m);
+		glUniformMatrix4fv(matrixUniform, 1, false, projection.m);
 
 		// we need the location of the uniform in order to set its value
 		GLuint color = glGetUniformLocation(programId, "color");
@@ -153,6 +145,7 @@ int main(int argc, char **argv)
 		glBindBuffer(GL_ARRAY_BUFFER, trianglesId);
 		glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
 		glDrawArrays(GL_TRIANGLES, 0, 3);
+		bench.drawCalls++;
 		glDisableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
 
 		// render the quad in blue
@@ -161,9 +154,16 @@ int main(int argc, char **argv)
 		glBindBuffer(GL_ARRAY_BUFFER, quadId);
 		glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
 		glDrawArrays(GL_TRIANGLES, 0, 6);
+		bench.drawCalls++;
 		glDisableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
 
 		SDL_GL_SwapWindow(win);
+		if (pacer.Frame()) {
+			SDL_SetWindowTitle(win, ("GLEW Test - " + pacer.Summary()).c_str());
+		}
+		if (!bench.Frame()) {
+			done = true;
+		}
     }
 
 	SDL_GL_DeleteContext(ctx);
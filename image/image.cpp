@@ -1,18 +1,187 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 #include <SDL.h>
 #include <SDL_image.h>
+#include <GL/glew.h>
+#include "archive.h"
+#include "assetloader.h"
+#include "bench.h"
+#include "framepacer.h"
+#include "pixels.h"
+#include "uploadqueue.h"
 
 // image: www.freeimages.co.uk
 
+// A decoded image, as the RGBA rows glTexImage2D takes, along with its mip levels when
+// they are made on the CPU.
+struct Image {
+	int width;
+	int height;
+	std::vector<std::shared_ptr<std::vector<GLubyte>>> levels;
+	int LevelWidth(int level) const {
+		return std::max(1, width >> level);
+	}
+	int LevelHeight(int level) const {
+		return std::max(1, height >> level);
+	}
+	// down to 1x1
+	int LevelCount() const {
+		int count = 1;
+		while (LevelWidth(count - 1) > 1 || LevelHeight(count - 1) > 1) {
+			count++;
+		}
+		return count;
+	}
+};
+
+// Exits with the info log when the shader did not compile.
+void CheckShader(GLuint id) {
+	GLint status;
+	glGetShaderiv(id, GL_COMPILE_STATUS, &status);
+	if (status != GL_TRUE) {
+		GLint logLength;
+		glGetShaderiv(id, GL_INFO_LOG_LENGTH, &logLength);
+		std::vector<GLchar> log(logLength + 1, 0);
+		glGetShaderInfoLog(id, logLength, NULL, &log[0]);
+		std::cout << "Shader compilation failed:" << std::endl << &log[0] << std::endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+// Exits with the info log when the program did not link.
+void CheckProgram(GLuint id) {
+	GLint status;
+	glGetProgramiv(id, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		GLint logLength;
+		glGetProgramiv(id, GL_INFO_LOG_LENGTH, &logLength);
+		std::vector<GLchar> log(logLength + 1, 0);
+		glGetProgramInfoLog(id, logLength, NULL, &log[0]);
+		std::cout << "Program link failed:" << std::endl << &log[0] << std::endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
 int main(int argc, char** argv)
 {
-	SDL_Init(SDL_INIT_EVERYTHING);
+	Bench bench("image", argc, argv);
+	FramePacer pacer(argc, argv);
+	bool serialLoad = false; // "--serial-load" gives the startup time without the loader threads
+	bool syncUpload = false; // "--sync-upload" uploads the image with a single glTexImage2D, stalling that frame
+	bool gpuMipmaps = false; // "--gpu-mipmaps" has glGenerateMipmap make the mip levels instead of the loader
+	int thumbnails = 1; // "--thumbnails <n>" shows the image n times across and down
+	for (int i=1; i < argc; i++) {
+		if (std::string(argv[i]) == "--serial-load") {
+			serialLoad = true;
+		}
+		if (std::string(argv[i]) == "--sync-upload") {
+			syncUpload = true;
+		}
+		if (std::string(argv[i]) == "--gpu-mipmaps") {
+			gpuMipmaps = true;
+		}
+		if (std::string(argv[i]) == "--thumbnails" && i + 1 < argc) {
+			thumbnails = std::max(1, atoi(argv[i+1]));
+		}
+	}
+	Archive archive;
+	archive.Map("../assets.pak"); // loose files are read instead when there is no archive
+	RequireSDL(SDL_Init(SDL_INIT_EVERYTHING) == 0, "SDL_Init");
 	IMG_Init(IMG_INIT_JPG);
-	SDL_Window *win = SDL_CreateWindow("Image Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1024, 768, SDL_WINDOW_SHOWN);
-	SDL_Renderer* renderer = SDL_CreateRenderer(win, -1, 0);
-	SDL_RWops* rwop = SDL_RWFromFile("beach.jpg", "rb");
-	SDL_Surface* image = IMG_LoadJPG_RW(rwop);
-    SDL_Texture* tex = SDL_CreateTextureFromSurface(renderer, image);
-	SDL_FreeSurface(image);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+
+	// decode and convert the image while the window and the context are being created,
+	// and while the first frames are shown
+	AssetLoader loader(serialLoad ? 0 : AssetLoader::DefaultWorkers());
+	std::shared_future<Image> decoded = loader.Load([&archive, gpuMipmaps]() {
+		SDL_RWops* rwop = archive.Open("beach.jpg");
+		SDL_Surface* surface = IMG_LoadJPG_RW(rwop);
+		SDL_RWclose(rwop);
+		Image image;
+		if (surface == NULL) {
+			// SDL keeps the error of each thread apart, this is the decoder's
+			std::cout << "Could not decode beach.jpg: " << IMG_GetError() << std::endl;
+			image.width = 0;
+			image.height = 0;
+			return image; // no levels, the main thread never uploads it
+		}
+		image.width = surface->w;
+		image.height = surface->h;
+		image.levels.push_back(std::make_shared<std::vector<GLubyte>>(surface->w * surface->h * 4));
+		SurfaceToRGBA(surface, &(*image.levels[0])[0], surface->w * 4);
+		SDL_FreeSurface(surface);
+		for (int level=1; !gpuMipmaps && level < image.LevelCount(); level++) {
+			image.levels.push_back(std::make_shared<std::vector<GLubyte>>(image.LevelWidth(level) * image.LevelHeight(level) * 4));
+			HalveRGBA(&(*image.levels[level-1])[0], image.LevelWidth(level-1), image.LevelHeight(level-1), &(*image.levels[level])[0]);
+		}
+		return image;
+	});
+
+	SDL_Window *win = SDL_CreateWindow("Image Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1024, 768, bench.WindowFlags(SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN));
+	RequireSDL(win != NULL, "SDL_CreateWindow");
+	SDL_GLContext ctx = SDL_GL_CreateContext(win);
+	RequireSDL(ctx != NULL, "SDL_GL_CreateContext");
+	glewExperimental = GL_TRUE; // otherwise GLEW skips the entry points missing from the core profile extension string
+	glewInit(); // must be called AFTER the OpenGL context has been created
+	glGetError(); // glewInit raises GL_INVALID_ENUM on core contexts
+	pacer.Apply();
+	glViewport(0, 0, 1024, 768);
+
+	//
+	// create the shader program, which stretches the image over a rectangle of the window
+	//
+    const GLchar* vertexShaderSource =
+		"#version 330 core\n\
+		 uniform vec4 rect;\
+		 out vec2 vTexCoord;\
+		 void main(void) {\
+			vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\
+			gl_Position = vec4(rect.xy + corner * rect.zw, 0.0, 1.0);\
+			vTexCoord = corner;\
+		 }";
+    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShaderId, 1, &vertexShaderSource, NULL);
+    glCompileShader(vertexShaderId);
+	CheckShader(vertexShaderId);
+    const GLchar* fragmentShaderSource =
+		"#version 330 core\n\
+		 uniform sampler2D tex;\
+		 in vec2 vTexCoord;\
+		 out vec4 fColor;\
+		 void main(void) {\
+			fColor = texture(tex, vTexCoord);\
+		 }";
+    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShaderId, 1, &fragmentShaderSource, NULL);
+    glCompileShader(fragmentShaderId);
+	CheckShader(fragmentShaderId);
+    GLuint programId = glCreateProgram();
+    glAttachShader(programId, vertexShaderId);
+    glAttachShader(programId, fragmentShaderId);
+    glLinkProgram(programId);
+	CheckProgram(programId);
+	glUseProgram(programId);
+	glUniform1i(glGetUniformLocation(programId, "tex"), 0);
+	GLint rectUniform = glGetUniformLocation(programId, "rect");
+
+	// the quad corners come from the vertex index, but core profiles still need a vertex array
+	GLuint vertexArrayId;
+	glGenVertexArrays(1, &vertexArrayId);
+	glBindVertexArray(vertexArrayId);
+
+	// the image goes up in bands through pixel buffers, and is drawn once complete
+	std::shared_ptr<UploadQueue> uploads(new UploadQueue(serialLoad ? NULL : &loader));
+	GLuint textureId = 0;
+	bool mipmapsPending = false;
 
 	SDL_Event event;
 	while (1) {
@@ -21,13 +190,63 @@ int main(int argc, char** argv)
 				break;
 			}
 		}
-		SDL_RenderClear(renderer);
-		SDL_RenderCopy(renderer, tex, NULL, NULL);
-		SDL_RenderPresent(renderer);
+		if (textureId == 0 && decoded.wait_for(std::chrono::seconds(0)) == std::future_status::ready && !decoded.get().levels.empty()) {
+			const Image& image = decoded.get();
+			glGenTextures(1, &textureId);
+			glBindTexture(GL_TEXTURE_2D, textureId);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			// minified, as thumbnails are, the image is sampled from the two nearest mip levels
+			// instead of skipping over texels, which aliases and reads the whole image
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			for (int level=0; level < image.LevelCount(); level++) {
+				const bool data = syncUpload && level < (int) image.levels.size();
+				glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, image.LevelWidth(level), image.LevelHeight(level), 0, GL_RGBA, GL_UNSIGNED_BYTE,
+					data ? &(*image.levels[level])[0] : NULL);
+			}
+			for (size_t level=0; !syncUpload && level < image.levels.size(); level++) {
+				uploads->Upload(textureId, 0, 0, image.LevelWidth(level), image.LevelHeight(level), GL_RGBA, image.levels[level], level);
+			}
+			mipmapsPending = gpuMipmaps;
+		}
+		uploads->Pump();
+		if (mipmapsPending && uploads->Pending(textureId) == 0) {
+			glBindTexture(GL_TEXTURE_2D, textureId);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			mipmapsPending = false;
+		}
+
+		glClear(GL_COLOR_BUFFER_BIT);
+		if (textureId != 0 && !mipmapsPending && uploads->Pending(textureId) == 0) {
+			glBindTexture(GL_TEXTURE_2D, textureId);
+			const float size = 2.0f / thumbnails;
+			for (int i=0; i < thumbnails * thumbnails; i++) {
+				glUniform4f(rectUniform, -1.0f + i % thumbnails * size, -1.0f + i / thumbnails * size, size, size);
+				glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+				bench.drawCalls++;
+			}
+		}
+		SDL_GL_SwapWindow(win);
+		if (pacer.Frame()) {
+			std::stringstream title;
+			title.precision(1);
+			title << std::fixed << "Image Test - " << pacer.Summary() << ", upload " << uploads->megabytesPerSecond
+				<< " MB/s, queue depth " << uploads->Depth();
+			SDL_SetWindowTitle(win, title.str().c_str());
+		}
+		if (!bench.Frame()) {
+			break;
+		}
    }
 
-	SDL_DestroyTexture(tex);
-	SDL_DestroyRenderer(renderer);
+	uploads.reset(); // its buffers and fences go while the context is still current
+	glDeleteTextures(1, &textureId);
+	glDeleteVertexArrays(1, &vertexArrayId);
+	glDeleteProgram(programId);
+	glDeleteShader(vertexShaderId);
+	glDeleteShader(fragmentShaderId);
+	SDL_GL_DeleteContext(ctx);
 	SDL_DestroyWindow(win);
 
 	SDL_Quit();
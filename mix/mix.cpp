@@ -1,20 +1,14 @@
 #include <iostream>
-#include <sys/stat.h>
+#include <string>
+#include <string.h>
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <GL/glew.h>
-
-char* readTextFile(const char* filename) {
-    struct stat st;
-    stat(filename, &st);
-    int size = st.st_size;
-    char* content = (char*) malloc((size+1)*sizeof(char));
-    content[size] = 0;
-    // we need to read as binary, not text, otherwise we are screwed on Windows
-    FILE *file = fopen(filename, "rb");
-    fread(content, 1, size, file);
-    return content;
-}
+#include "archive.h"
+#include "bench.h"
+#include "framepacer.h"
+#include "matrix.h"
+#include "pixels.h"
 
 int main(int argc, char** argv)
 {
@@ -26,21 +20,28 @@ int main(int argc, char** argv)
 	const int height = 600;
 	const float aspectRatio = 1.0f * width / height;
 
-	SDL_Init(SDL_INIT_EVERYTHING);
+	Bench bench("mix", argc, argv);
+	FramePacer pacer(argc, argv);
+	Archive archive;
+	archive.Map("../assets.pak"); // loose files are read instead when there is no archive
+	RequireSDL(SDL_Init(SDL_INIT_EVERYTHING) == 0, "SDL_Init");
 	TTF_Init();
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
-	SDL_Window *win = SDL_CreateWindow("Mix Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN);
+	SDL_Window *win = SDL_CreateWindow("Mix Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, bench.WindowFlags(SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN));
 
+	RequireSDL(win != NULL, "SDL_CreateWindow");
 	SDL_GLContext ctx = SDL_GL_CreateContext(win);
+	RequireSDL(ctx != NULL, "SDL_GL_CreateContext");
 	glewInit(); // must be called AFTER the OpenGL context has been created
+	pacer.Apply();
     glViewport(0, 0, width, height);
 
 	SDL_Renderer* renderer = SDL_CreateRenderer(win, -1, 0);
-	TTF_Font* font = TTF_OpenFont("arial.ttf", 128);
-	SDL_Color text_color = {255, 255, 255};
+	TTF_Font* font = TTF_OpenFontRW(archive.Open("arial.ttf"), 1, 128);
+	SDL_Color text_color = {255, 255, 255, 255};
 	SDL_Surface* text = TTF_RenderText_Solid(font, "Hello, SDL!", text_color);
 
 	//
@@ -48,15 +49,17 @@ int main(int argc, char** argv)
 	//
 
 	// compile the vertex shader
-    const GLchar* vertexShaderSource = readTextFile("mix.vert");
-    int vertexShaderSourceLength = strlen(vertexShaderSource);
+    const std::string vertexShaderText = archive.ReadText("mix.vert");
+    const GLchar* vertexShaderSource = vertexShaderText.c_str();
+    int vertexShaderSourceLength = vertexShaderText.length();
     GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertexShaderId, 1, &vertexShaderSource, &vertexShaderSourceLength);
     glCompileShader(vertexShaderId);
 
 	// compile the fragment shader
-    const GLchar* fragmentShaderSource = readTextFile("mix.frag");
-    int fragmentShaderSourceLength = strlen(fragmentShaderSource);
+    const std::string fragmentShaderText = archive.ReadText("mix.frag");
+    const GLchar* fragmentShaderSource = fragmentShaderText.c_str();
+    int fragmentShaderSourceLength = fragmentShaderText.length();
     GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragmentShaderId, 1, &fragmentShaderSource, &fragmentShaderSourceLength);
     glCompileShader(fragmentShaderId);
@@ -75,6 +78,11 @@ int main(int argc, char** argv)
 	// create quad buffer
 	//
 
+	// the vertex array object remembers the buffers and attribute layout of the quad
+	GLuint quadVertexArrayId;
+	glGenVertexArrays(1, &quadVertexArrayId);
+	glBindVertexArray(quadVertexArrayId);
+
 	// create positions
     float positions[] = {
         1.4f, 1.0f, 0.0f,
@@ -86,6 +94,8 @@ int main(int argc, char** argv)
     glGenBuffers(1, &quadId);
     glBindBuffer(GL_ARRAY_BUFFER, quadId);
     glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
+	glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
 	// create texture coordinates
 	float texcoords[] = {
@@ -98,29 +108,26 @@ int main(int argc, char** argv)
 	glGenBuffers(1, &quadTexId);
 	glBindBuffer(GL_ARRAY_BUFFER, quadTexId);
     glBufferData(GL_ARRAY_BUFFER, sizeof(texcoords), texcoords, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(TEXCOORD_ATTRIBUTE_INDEX);
+	glVertexAttribPointer(TEXCOORD_ATTRIBUTE_INDEX, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+	// the quad is drawn as two triangles since GL_QUADS is not available in core profiles
+	GLushort indices[] = {
+		0, 1, 2,
+		0, 2, 3
+	};
+	GLuint quadIndicesId;
+	glGenBuffers(1, &quadIndicesId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndicesId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glBindVertexArray(0);
 
 	//
 	// create the texture
 	//
 
-	if (text->format->BitsPerPixel != 8) {
-		std::cout << "Pixel format not supported (" << text->format->BitsPerPixel << ")" << std::endl;
-		exit(EXIT_FAILURE);
-	}
-	SDL_Palette* palette = text->format->palette;
-	char* p = (char*) text->pixels;
     GLubyte* textureData = new GLubyte[text->w * text->h * 4];
-	GLubyte* t = textureData;
-	//for (int i=0; i < text->h; i++) {
-	for (int i=text->h; i > 0; i--) {
-		for (int j=0; j < text->w; j++) {
-			SDL_Color color = palette->colors[p[i*text->pitch+j]];
-			*t++ = color.r;
-			*t++ = color.g;
-			*t++ = color.b;
-			*t++ = 255;
-		}
-	}
+	SurfaceToRGBA(text, textureData, text->w * 4);
 
 	GLuint textureId;
     glGenTextures(1, &textureId);
@@ -130,34 +137,14 @@ int main(int argc, char** argv)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, text->w, text->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, textureData);
+	delete[] textureData;
 	SDL_FreeSurface(text);
 
 	//
 	// defines the orthographic projection matrix
 	//
-	float m[16];
-	const float left = -1.5f;
-	const float right = 1.5f;
-	const float bottom = -1.5f;
-	const float top = 1.5f;
-	const float nearp = 1.0f;
-	const float farp = -1.0f;
-    m[0] = 2 / (right - left);
-    m[1] = 0.0f;
-    m[2] = 0.0f;
-    m[3] = 0.0f;
-    m[4] = 0.0f;
-    m[5] = 2 / (top - bottom);
-    m[6] = 0.0f;
-    m[7] = 0.0f;
-    m[8] = 0.0f;
-    m[9] = 0.0f;
-    m[10] = 2 / (farp - nearp);
-    m[11] = 0.0f;
-    m[12] = -(right + left) / (right - left);
-    m[13] = -(top + bottom) / (top - bottom);
-    m[14] = -(farp + nearp) / (farp - nearp);
-    m[15] = 1.0f;
+	// the bounds are constants, so the matrix is computed at compile time where constexpr is supported
+	static const Matrix44<float> projection = Ortho(1.5f, -1.5f, 1.5f, -1.5f, 1.0f, -1.0f);
 
 	//
 	// SDL main loop
@@ -183,22 +170,22 @@ int main(int argc, char** argv)
 		glBindTexture(GL_TEXTURE_2D, textureId);
 
 		GLuint matrixUniform = glGetUniformLocation(programId, "mvpMatrix");
-		glUniformMatrix4fv(matrixUniform, 1, false, m);
+		glUniformMatrix4fv(matrixUniform, 1, false, projection.m);
 		GLuint textureUniform = glGetUniformLocation(programId, "texture");
 		glUniform1i(textureUniform, 0);
 
-		glEnableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
-		glBindBuffer(GL_ARRAY_BUFFER, quadId);
-		glVertexAttribPointer(POSITION_ATTRIBUTE_INDEX, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(TEXCOORD_ATTRIBUTE_INDEX);
-		glBindBuffer(GL_ARRAY_BUFFER, quadTexId);
-		glVertexAttribPointer(TEXCOORD_ATTRIBUTE_INDEX, 2, GL_FLOAT, GL_FALSE, 0, 0);
-		glDrawArrays(GL_QUADS, 0, 4);
-		glDisableVertexAttribArray(POSITION_ATTRIBUTE_INDEX);
-		glDisableVertexAttribArray(TEXCOORD_ATTRIBUTE_INDEX);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(quadVertexArrayId);
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+		bench.drawCalls++;
+		glBindVertexArray(0);
 
 		SDL_GL_SwapWindow(win);
+		if (pacer.Frame()) {
+			SDL_SetWindowTitle(win, ("Mix Test - " + pacer.Summary()).c_str());
+		}
+		if (!bench.Frame()) {
+			break;
+		}
 	}
 
 	SDL_DestroyRenderer(renderer);
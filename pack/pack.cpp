@@ -0,0 +1,98 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <SDL.h>
+#include "archive.h"
+
+// Packs asset files into one archive that the demos map in memory, see archive.h.
+// Assets are named after their file name without the directory, which is how the
+// demos ask for them; when two files share a name, the first one wins.
+//
+//   pack <archive> <file>...
+//
+// From the solution directory, the archive the demos look for is built with
+//
+//   pack assets.pak fps/arial.ttf fps/monochrome.vert fps/monochrome.frag fps/texture.vert
+//        fps/text.frag fps/sdf.frag fps/sprite.vert fps/sprite.frag
+//        mix/mix.vert mix/mix.frag image/beach.jpg
+//
+// followed by the font atlases made with the bake tool, if any.
+
+std::string BaseName(const std::string& path) {
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3) {
+		std::cout << "usage: pack <archive> <file>..." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<ArchiveEntry> entries;
+	std::vector<std::vector<char>> blobs;
+	for (int i=2; i < argc; i++) {
+		const std::string name = BaseName(argv[i]);
+		if (name.size() >= ARCHIVE_NAME_LENGTH) {
+			std::cout << "Name too long: " << name << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		bool duplicate = false;
+		for (size_t j=0; j < entries.size(); j++) {
+			duplicate = duplicate || name == entries[j].name;
+		}
+		if (duplicate) {
+			std::cout << "Skipping " << argv[i] << ", " << name << " is already packed" << std::endl;
+			continue;
+		}
+		std::ifstream f(argv[i], std::ios::binary);
+		if (!f) {
+			std::cout << "Cannot read " << argv[i] << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		blobs.push_back(std::vector<char>((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>()));
+		ArchiveEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		strncpy(entry.name, name.c_str(), ARCHIVE_NAME_LENGTH - 1);
+		entry.size = blobs.back().size();
+		entries.push_back(entry);
+	}
+
+	// the blobs follow the index, each one aligned
+	Uint64 offset = sizeof(ArchiveHeader) + entries.size() * sizeof(ArchiveEntry);
+	for (size_t i=0; i < entries.size(); i++) {
+		offset = (offset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+		entries[i].offset = offset;
+		offset += entries[i].size;
+	}
+
+	std::ofstream out(argv[1], std::ios::binary);
+	ArchiveHeader header;
+	memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+	header.count = entries.size();
+	header.reserved = 0;
+	out.write((const char*) &header, sizeof(header));
+	if (!entries.empty()) {
+		out.write((const char*) &entries[0], entries.size() * sizeof(ArchiveEntry));
+	}
+	for (size_t i=0; i < entries.size(); i++) {
+		const std::vector<char> padding((size_t) entries[i].offset - (size_t) out.tellp(), 0);
+		if (!padding.empty()) {
+			out.write(&padding[0], padding.size());
+		}
+		if (!blobs[i].empty()) {
+			out.write(&blobs[i][0], blobs[i].size());
+		}
+		std::cout << entries[i].name << ": " << entries[i].size << " bytes at " << entries[i].offset << std::endl;
+	}
+	if (!out) {
+		std::cout << "Cannot write " << argv[1] << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	return EXIT_SUCCESS;
+}
@@ -1,17 +1,96 @@
+#include <string>
 #include <SDL.h>
 #include <SDL_ttf.h>
+#include "archive.h"
+#include "fontatlas.h"
+#include "framepacer.h"
+
+const char* TEXT = "Hello SDL!";
+
+// Whether the atlas has every character of TEXT, and they add up to some extent to stretch;
+// an atlas baked for other characters is not used.
+bool AtlasCoversText(const FontAtlas& atlas) {
+	const std::string text = TEXT;
+	int textWidth = 0, textHeight = 0;
+	for (size_t i=0; i < text.size(); i++) {
+		if (!atlas.Contains((Uint8) text[i])) {
+			return false;
+		}
+		const Glyph& g = atlas.glyphs[(Uint8) text[i]];
+		textWidth += g.advance;
+		textHeight = std::max(textHeight, g.offsetY + g.height);
+	}
+	return textWidth > 0 && textHeight > 0;
+}
+
+// Draws TEXT from an atlas baked with the bake tool, stretched over the whole window like
+// the text rendered by SDL_ttf: from the bottom of the line box to the top of the tallest
+// glyph, and from the pen's start to its end.
+void RenderBakedText(SDL_Renderer* renderer, const FontAtlas& atlas, SDL_Texture* tex, int width, int height) {
+	const std::string text = TEXT;
+	int textWidth = 0, textHeight = 0;
+	for (size_t i=0; i < text.size(); i++) {
+		const Glyph& g = atlas.glyphs[(Uint8) text[i]];
+		textWidth += g.advance + (i > 0 ? atlas.Kerning((Uint8) text[i-1], (Uint8) text[i]) : 0);
+		textHeight = std::max(textHeight, g.offsetY + g.height);
+	}
+	float sx = (float) width / textWidth;
+	float sy = (float) height / textHeight;
+	int x = 0;
+	for (size_t i=0; i < text.size(); i++) {
+		const Glyph& g = atlas.glyphs[(Uint8) text[i]];
+		x += i > 0 ? atlas.Kerning((Uint8) text[i-1], (Uint8) text[i]) : 0;
+		// the atlas rows are stored bottom row first, and offsets count up from the bottom of the line
+		SDL_Rect src = { g.x, atlas.height - g.y - g.height, g.width, g.height };
+		SDL_Rect dst = { (int) ((x + g.offsetX) * sx), (int) ((textHeight - g.offsetY - g.height) * sy),
+			(int) (g.width * sx + 0.5f), (int) (g.height * sy + 0.5f) };
+		SDL_RenderCopy(renderer, tex, &src, &dst);
+		x += g.advance;
+	}
+}
+
+// Turns the coverage of a baked atlas into a white texture with coverage as alpha, top row first.
+SDL_Texture* CreateAtlasTexture(SDL_Renderer* renderer, const FontAtlas& atlas) {
+	SDL_Surface* s = SDL_CreateRGBSurface(0, atlas.width, atlas.height, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+	for (int i=0; i < atlas.height; i++) {
+		Uint32* row = (Uint32*) ((Uint8*) s->pixels + i * s->pitch);
+		const Uint8* coverage = &atlas.pixels[(atlas.height - 1 - i) * atlas.width];
+		for (int j=0; j < atlas.width; j++) {
+			row[j] = (Uint32) coverage[j] << 24 | 0x00ffffff;
+		}
+	}
+	SDL_Texture* tex = SDL_CreateTextureFromSurface(renderer, s);
+	SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+	SDL_FreeSurface(s);
+	return tex;
+}
 
 int main(int argc, char** argv)
 {
+	FramePacer pacer(argc, argv);
+	Archive archive;
+	archive.Map("../assets.pak"); // loose files are read instead when there is no archive
 	SDL_Init(SDL_INIT_EVERYTHING);
 	TTF_Init();
 	SDL_Window *win = SDL_CreateWindow("TTF Test", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1000, 600, SDL_WINDOW_SHOWN);
-	SDL_Renderer* renderer = SDL_CreateRenderer(win, -1, 0);
-	TTF_Font* font = TTF_OpenFont("arial.ttf", 512);
-	SDL_Color text_color = {255, 255, 255};
-	SDL_Surface *text = TTF_RenderText_Solid(font, "Hello SDL!", text_color);
-    SDL_Texture *tex = SDL_CreateTextureFromSurface(renderer, text);
-	SDL_FreeSurface(text);
+	SDL_Renderer* renderer = SDL_CreateRenderer(win, -1, pacer.RendererFlags());
+
+	// 512 point glyphs are slow to rasterize, so an atlas baked with
+	// bake ttf/arial.ttf 512 ttf/arial-512.fontatlas "Hello SDL!" is used when there is one
+	FontAtlas atlas;
+	SDL_RWops* baked = archive.TryOpen("arial-512.fontatlas");
+	SDL_Texture *tex;
+	if (baked != NULL && LoadFontAtlas(atlas, baked) && !atlas.DistanceField() && AtlasCoversText(atlas)) {
+		tex = CreateAtlasTexture(renderer, atlas);
+	} else {
+		atlas = FontAtlas(); // distance fields need a shader, which SDL_Renderer does not have
+		TTF_Font* font = TTF_OpenFontRW(archive.Open("arial.ttf"), 1, 512);
+		SDL_Color text_color = {255, 255, 255, 255};
+		SDL_Surface *text = TTF_RenderText_Solid(font, TEXT, text_color);
+		tex = SDL_CreateTextureFromSurface(renderer, text);
+		SDL_FreeSurface(text);
+		TTF_CloseFont(font);
+	}
 
 	SDL_Event event;
 	while (1) {
@@ -21,8 +100,15 @@ int main(int argc, char** argv)
 			}
 		}
 		SDL_RenderClear(renderer);
-		SDL_RenderCopy(renderer, tex, NULL, NULL);
+		if (atlas.width > 0) {
+			RenderBakedText(renderer, atlas, tex, 1000, 600);
+		} else {
+			SDL_RenderCopy(renderer, tex, NULL, NULL);
+		}
 		SDL_RenderPresent(renderer);
+		if (pacer.Frame()) {
+			SDL_SetWindowTitle(win, ("TTF Test - " + pacer.Summary()).c_str());
+		}
    }
 
 	SDL_DestroyTexture(tex);